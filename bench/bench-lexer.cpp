@@ -0,0 +1,103 @@
+// Lexer throughput on large text-heavy templates
+// usage: wizard_bench [size in MB]
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "../library/Config.h"
+#include "../library/Lexer.h"
+
+using namespace Wizard;
+
+// mostly text with rare expressions and statements
+static std::string make_template(size_t size)
+{
+    const std::string_view chunk =
+        "CREATE TABLE IF NOT EXISTS orders (id INTEGER PRIMARY KEY, customer_id INTEGER NOT NULL,\n"
+        "    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP, total NUMERIC(12, 2), status VARCHAR(32));\n"
+        "-- indexes are created after the data load to keep the import fast enough\n"
+        "CREATE INDEX IF NOT EXISTS orders_customer ON orders (customer_id);\n";
+    std::string result;
+    result.reserve(size + 256);
+    size_t counter = 0;
+    while (result.size() < size) {
+        result += chunk;
+        if (++counter % 4 == 0) {
+            result += "## if table.comment\nCOMMENT ON TABLE {{ table.name }} IS '{{ table.comment }}';\n## endif\n";
+        }
+    }
+    return result;
+}
+
+template <typename Function>
+static double measure(size_t bytes, int iterations, Function&& function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        function();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(bytes) * iterations / elapsed.count() / (1024.0 * 1024.0);
+}
+
+int main(int argc, const char* argv[])
+{
+    const size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 16;
+    const int iterations = 10;
+    const std::string text = make_template(megabytes * 1024 * 1024);
+    const std::string_view open_chars = "#{";
+
+    size_t found = 0;
+    auto scan = [&](auto find) {
+        return [&, find] {
+            std::string_view rest = text;
+            for (;;) {
+                const size_t pos = find(rest, open_chars);
+                if (pos == std::string_view::npos) {
+                    break;
+                }
+                found += 1;
+                rest.remove_prefix(pos + 1);
+            }
+        };
+    };
+    std::cout << "text size: " << text.size() << " bytes" << std::endl;
+    std::cout << "find_first_of (std::string_view): "
+              << measure(text.size(), iterations, scan([](std::string_view t, std::string_view c) { return t.find_first_of(c); }))
+              << " MB/s" << std::endl;
+    std::cout << "find_first_of (scalar):           "
+              << measure(text.size(), iterations, scan([](std::string_view t, std::string_view c) { return text_scan::find_first_of_scalar(t, c); }))
+              << " MB/s" << std::endl;
+#ifdef WIZARD_TEXT_SCAN_X86
+    std::cout << "find_first_of (sse2):             "
+              << measure(text.size(), iterations, scan([](std::string_view t, std::string_view c) { return text_scan::find_first_of_sse2(t, c); }))
+              << " MB/s" << std::endl;
+#endif
+    std::cout << "find_first_of (runtime selected): "
+              << measure(text.size(), iterations, scan([](std::string_view t, std::string_view c) { return text_scan::find_first_of(t, c); }))
+              << " MB/s" << std::endl;
+
+    LexerConfig config;
+    size_t tokens = 0;
+    std::cout << "lexer:                            "
+              << measure(text.size(), iterations, [&] {
+                     Lexer lexer(config);
+                     auto state = lexer.start(text);
+                     while ((state = lexer.scan(state)).token.kind != Token::Kind::Eof) {
+                         tokens += 1;
+                     }
+                 })
+              << " MB/s" << std::endl;
+    std::cout << "lexer (default delimiters):       "
+              << measure(text.size(), iterations, [&] {
+                     DefaultLexer lexer(config);
+                     auto state = lexer.start(text);
+                     while ((state = lexer.scan(state)).token.kind != Token::Kind::Eof) {
+                         tokens += 1;
+                     }
+                 })
+              << " MB/s" << std::endl;
+    // keep results alive
+    std::cout << "(" << found << " candidates, " << tokens << " tokens)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Rendering of number-heavy templates (generated SQL/CSV)
+// usage: wizard_bench_render [rows in thousands]
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../library/Environment.h"
+
+using namespace Wizard;
+
+// rows of integers and doubles
+static json::value make_data(size_t rows)
+{
+    json::array array;
+    array.reserve(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        json::object row;
+        row["id"] = i;
+        row["customer"] = static_cast<int64_t>(i * 7919 % 100000) - 50000;
+        row["quantity"] = i % 1000;
+        row["price"] = static_cast<double>(i % 100000) / 100.0;
+        array.emplace_back(std::move(row));
+    }
+    json::object data;
+    data["rows"] = std::move(array);
+    return data;
+}
+
+template <typename Function>
+static double measure(int iterations, Function&& function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        function();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, const char* argv[])
+{
+    const size_t rows = (argc > 1 ? std::stoul(argv[1]) : 500) * 1000;
+    const int iterations = 5;
+    const json::value data = make_data(rows);
+
+    Environment env;
+    const auto csv = env.parse("## for row in rows\n{{ row.id }},{{ row.customer }},{{ row.quantity }},{{ row.price }}\n## endfor\n");
+    const auto sql = env.parse("## for row in rows\n"
+                               "INSERT INTO orders VALUES ({{ row.id }}, {{ row.customer }}, {{ row.quantity }}, {{ row.price }});\n"
+                               "## endfor\n");
+
+    size_t size = 0;
+    auto report = [&](const char* name, double seconds) {
+        std::cout << name << seconds * 1000.0 << " ms, "
+                  << static_cast<double>(size) / seconds / (1024.0 * 1024.0) << " MB/s, "
+                  << static_cast<double>(rows * 4) / seconds / 1e6 << " M numbers/s" << std::endl;
+    };
+    std::cout << "rows: " << rows << std::endl;
+
+    report("csv to string:         ", measure(iterations, [&] { size = env.render(csv, data).size(); }));
+    report("sql to string:         ", measure(iterations, [&] { size = env.render(sql, data).size(); }));
+    report("csv to counting sink:  ", measure(iterations, [&] {
+        CountingSink output;
+        env.render(output, csv, data);
+        size = output.count();
+    }));
+
+    // number formatting alone (stream output vs std::to_chars)
+    const auto& values = data.at("rows").as_array();
+    report("stream formatting:     ", measure(iterations, [&] {
+        std::ostringstream os;
+        for (const auto& row : values) {
+            const auto& object = row.as_object();
+            os << object.at("id").as_uint64() << object.at("customer").as_int64()
+               << object.at("quantity").as_uint64() << object.at("price").as_double();
+        }
+        size = os.view().size();
+    }));
+    report("to_chars formatting:   ", measure(iterations, [&] {
+        std::string result;
+        {
+            StringSink output(result);
+            char buffer[32];
+            auto print = [&](auto... value) {
+                const auto end = std::to_chars(buffer, buffer + sizeof(buffer), value...).ptr;
+                output.write(buffer, static_cast<size_t>(end - buffer));
+            };
+            for (const auto& row : values) {
+                const auto& object = row.as_object();
+                print(object.at("id").as_uint64());
+                print(object.at("customer").as_int64());
+                print(object.at("quantity").as_uint64());
+                print(object.at("price").as_double(), std::chars_format::general, 6);
+            }
+        }
+        size = result.size();
+    }));
+    return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+#include "FunctionStorage.h"
+
+namespace Wizard
+{
+    // Renderer instructions (AST lowered into flat code)
+    enum class OpCode : char {
+        Text,           // write template content: pos, arg = length
+        Print,          // pop expression result and write it
+        Constant,       // push literal: arg = constant index
+        Data,           // push variable: arg = name index, extra = path index
+        Local,          // push loop or set variable: arg = name index, extra = local index
+        Member,         // replace container on top by its field: arg = name index
+        Call,           // call function: operation, arg = number arguments, extra = callback index
+        And,            // short-circuit "and": if top is false then push false and jump to target
+        Or,             // short-circuit "or": if top is true then push true and jump to target
+        Default,        // keep top and jump to target if it exists, otherwise evaluate fallback
+        Bool,           // replace top by its boolean value
+        Require,        // replace not found top by empty variable (or throw in strict mode)
+        Jump,           // jump to target
+        JumpIfFalse,    // pop expression result and jump to target if it is false
+        ForArray,       // pop array and start loop: arg = first loop slot, target = loop exit
+        ForObject,      // pop object and start loop: arg = first loop slot, target = loop exit
+        Next,           // next loop iteration: target = loop body
+        FileBegin,      // pop filename and redirect output
+        FileEnd,        // restore output
+        ApplyTemplate,  // render nested template: arg = template index, extra = field path (name index)
+        Set,            // pop expression result and set variable: arg = slot, extra = json pointer inside variable (name index)
+        Error,          // throw render error: arg = message (name index)
+    };
+
+    struct Instruction {
+        OpCode code;
+        FunctionStorage::Operation operation{FunctionStorage::Operation::None};
+        uint32_t arg{0};
+        uint32_t extra{0};
+        uint32_t target{0}; // jump address
+        size_t pos{0};      // position in template content (error location)
+    };
+
+    // index is not used
+    constexpr uint32_t no_index = UINT32_MAX;
+
+    // variable name split by dots (segment = name index)
+    using DataPath = std::vector<uint32_t>;
+
+    // variable known at compile time (loop variables have 3 slots: value, key, loop metadata)
+    struct Slot {
+        enum class Kind : char {
+            Set,
+            Value,
+            Key,
+            Loop,
+        };
+        Kind kind;
+        uint32_t name; // name index (no_index for key of array loop and loop metadata)
+    };
+
+    // reference to slot variable
+    struct LocalVariable {
+        uint32_t slot;
+        uint32_t path;      // segments after variable name (path index)
+        uint32_t data_path; // the whole name, if variable is not set (path index)
+    };
+
+    // compiled template: code + constant pool
+    struct Program {
+        std::vector<Instruction> code;
+        std::vector<json::value> constants;             // literals
+        std::vector<std::string> names;                 // variable names, json pointers, messages
+        std::vector<DataPath> paths;                    // variable names split into segments
+        std::vector<Slot> slots;                        // loop and set variables
+        std::vector<LocalVariable> locals;              // references to slots
+        std::string loop_variable_name;                 // name of loop metadata variable
+        std::vector<std::filesystem::path> templates;   // nested templates
+        std::vector<CallbackFunction> callbacks;        // user defined functions
+
+        bool empty() const { return code.empty(); }
+    };
+
+} // namespace Wizard
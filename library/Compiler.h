@@ -0,0 +1,318 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <vector>
+#include <utility>
+#include "Node.h"
+#include "Template.h"
+#include "Bytecode.h"
+
+namespace Wizard
+{
+    // Lowers template AST into flat bytecode (see Renderer)
+    class Compiler : public NodeVisitor
+    {
+        using Op = FunctionStorage::Operation;
+
+        Program program;
+        std::map<std::string, uint32_t> name_index;
+        std::map<std::filesystem::path, uint32_t> template_index;
+        std::map<std::string, uint32_t> path_index;
+
+        std::vector<std::pair<std::string, uint32_t>> scope;  // loop variables in scope (name, slot)
+        std::vector<uint32_t> loops;                          // first slots of enclosing loops
+        std::map<std::string, uint32_t> set_slots;            // variables of set statements
+        std::vector<std::pair<uint32_t, const DataNode*>> unresolved; // Data instructions (may be set variables)
+
+    public:
+        static std::shared_ptr<const Program> compile(const Template& tmpl, const std::string& loop_variable_name = "loop")
+        {
+            Compiler compiler;
+            compiler.program.loop_variable_name = loop_variable_name;
+            tmpl.root.accept(compiler);
+            compiler.resolve_set_variables();
+            return std::make_shared<const Program>(std::move(compiler.program));
+        }
+
+    protected:
+        uint32_t address() const {
+            return static_cast<uint32_t>(program.code.size());
+        }
+
+        uint32_t emit(OpCode code, size_t pos, uint32_t arg = 0, uint32_t extra = 0) {
+            program.code.push_back(Instruction{code, FunctionStorage::Operation::None, arg, extra, 0, pos});
+            return address() - 1;
+        }
+
+        // set jump address of instruction to the current address
+        void patch(uint32_t instruction) {
+            program.code[instruction].target = address();
+        }
+
+        uint32_t add_name(const std::string& name) {
+            auto [it, inserted] = name_index.emplace(name, static_cast<uint32_t>(program.names.size()));
+            if(inserted) {
+                program.names.push_back(name);
+            }
+            return it->second;
+        }
+
+        // path segments are interned in the names table
+        uint32_t add_path(const std::vector<std::string>& parts) {
+            std::string key;
+            for(const auto& part : parts) {
+                key += part;
+                key += '.';
+            }
+            auto [it, inserted] = path_index.emplace(key, static_cast<uint32_t>(program.paths.size()));
+            if(inserted) {
+                DataPath path;
+                path.reserve(parts.size());
+                for(const auto& part : parts) {
+                    path.push_back(add_name(part));
+                }
+                program.paths.push_back(std::move(path));
+            }
+            return it->second;
+        }
+
+        // variable in slot, the rest of path starts at segment "start"
+        uint32_t add_local(uint32_t slot, size_t start, const std::vector<std::string>& parts) {
+            const std::vector<std::string> rest(parts.begin() + static_cast<std::ptrdiff_t>(start), parts.end());
+            program.locals.push_back(LocalVariable{slot, add_path(rest), add_path(parts)});
+            return static_cast<uint32_t>(program.locals.size() - 1);
+        }
+
+        // slots of loop: value, key and loop metadata
+        uint32_t add_loop_slots(const std::string& value, const std::string* key) {
+            const auto first = static_cast<uint32_t>(program.slots.size());
+            program.slots.push_back(Slot{Slot::Kind::Value, add_name(value)});
+            program.slots.push_back(Slot{Slot::Kind::Key, key ? add_name(*key) : no_index});
+            program.slots.push_back(Slot{Slot::Kind::Loop, no_index});
+            return first;
+        }
+
+        // set statement changes loop variable in scope or template variable
+        uint32_t set_slot(const std::string& name) {
+            for(auto it = scope.rbegin(); it != scope.rend(); ++it) {
+                if(it->first == name) {
+                    return it->second;
+                }
+            }
+            auto [it, inserted] = set_slots.emplace(name, static_cast<uint32_t>(program.slots.size()));
+            if(inserted) {
+                program.slots.push_back(Slot{Slot::Kind::Set, add_name(name)});
+            }
+            return it->second;
+        }
+
+        // variables used before (or outside of loop with) set statement
+        void resolve_set_variables() {
+            for(const auto& [instruction, node] : unresolved) {
+                const auto it = set_slots.find(node->parts.front());
+                if(it != set_slots.end()) {
+                    program.code[instruction].code = OpCode::Local;
+                    program.code[instruction].extra = add_local(it->second, 1, node->parts);
+                }
+            }
+        }
+
+        uint32_t add_template(const std::filesystem::path& name) {
+            auto [it, inserted] = template_index.emplace(name, static_cast<uint32_t>(program.templates.size()));
+            if(inserted) {
+                program.templates.push_back(name);
+            }
+            return it->second;
+        }
+
+        // expression result is left on the evaluation stack
+        void compile_expression(const ExpressionWrapperNode& expression, size_t pos) {
+            if(!expression.root) {
+                emit(OpCode::Error, pos, add_name("empty expression"));
+                return;
+            }
+            expression.root->accept(*this);
+        }
+
+        void visit(const BlockNode& node) {
+            for (auto& child : node.nodes) {
+                child->accept(*this);
+            }
+        }
+
+        void visit(const TextNode& node) {
+            emit(OpCode::Text, node.pos, static_cast<uint32_t>(node.length));
+        }
+
+        void visit(const CommentNode&) {}
+
+        void visit(const ExpressionNode&) {}
+
+        void visit(const LiteralNode& node) {
+            program.constants.push_back(node.value);
+            emit(OpCode::Constant, node.pos, static_cast<uint32_t>(program.constants.size() - 1));
+        }
+
+        void visit(const DataNode& node) {
+            const auto& parts = node.parts;
+            if(parts.empty()) {
+                emit(OpCode::Data, node.pos, add_name(node.name), add_path(parts));
+                return;
+            }
+            if(parts.front() == program.loop_variable_name && !loops.empty()) {
+                // each "parent" is the outer loop
+                size_t level = loops.size() - 1;
+                size_t i = 1;
+                for(; i < parts.size() && parts[i] == "parent"; ++i) {
+                    if(level == 0) {
+                        // loop of parent template (see Renderer::apply_template)
+                        std::vector<std::string> inherited{parts.front()};
+                        inherited.insert(inherited.end(), parts.begin() + static_cast<std::ptrdiff_t>(i + 1), parts.end());
+                        emit(OpCode::Data, node.pos, add_name(node.name), add_path(inherited));
+                        return;
+                    }
+                    level -= 1;
+                }
+                emit(OpCode::Local, node.pos, add_name(node.name), add_local(loops[level] + 2, i, parts));
+                return;
+            }
+            for(auto it = scope.rbegin(); it != scope.rend(); ++it) {
+                if(it->first == parts.front()) {
+                    emit(OpCode::Local, node.pos, add_name(node.name), add_local(it->second, 1, parts));
+                    return;
+                }
+            }
+            const auto it = set_slots.find(parts.front());
+            if(it != set_slots.end()) {
+                emit(OpCode::Local, node.pos, add_name(node.name), add_local(it->second, 1, parts));
+                return;
+            }
+            unresolved.emplace_back(emit(OpCode::Data, node.pos, add_name(node.name), add_path(parts)), &node);
+        }
+
+        void visit(const FunctionNode& node) {
+            switch (node.operation) {
+            case Op::And:
+            case Op::Or:
+                {
+                    // the second argument is evaluated only if needed
+                    node.arguments[0]->accept(*this);
+                    auto jump = emit(node.operation == Op::And ? OpCode::And : OpCode::Or, node.pos);
+                    node.arguments[1]->accept(*this);
+                    emit(OpCode::Bool, node.pos);
+                    patch(jump);
+                }
+                break;
+            case Op::Default:
+                {
+                    node.arguments[0]->accept(*this);
+                    auto jump = emit(OpCode::Default, node.pos);
+                    node.arguments[1]->accept(*this);
+                    emit(OpCode::Require, node.pos);
+                    patch(jump);
+                }
+                break;
+            case Op::AtId: // through dot object.field
+                {
+                    node.arguments[0]->accept(*this);
+                    const auto id_node = dynamic_cast<const DataNode*>(node.arguments[1]);
+                    if(!id_node) {
+                        emit(OpCode::Error, node.pos, add_name("could not find element with given name"));
+                        break;
+                    }
+                    emit(OpCode::Member, node.pos, add_name(id_node->name));
+                }
+                break;
+            case Op::None:
+                break;
+            default:
+                {
+                    for (auto& argument : node.arguments) {
+                        argument->accept(*this);
+                    }
+                    auto call = emit(OpCode::Call, node.pos, static_cast<uint32_t>(node.arguments.size()));
+                    program.code[call].operation = node.operation;
+                    if (node.operation == Op::Callback) {
+                        program.callbacks.push_back(node.callback);
+                        program.code[call].extra = static_cast<uint32_t>(program.callbacks.size() - 1);
+                    }
+                }
+                break;
+            }
+        }
+
+        void visit(const ExpressionWrapperNode& node) {
+            compile_expression(node, node.pos);
+            emit(OpCode::Print, node.pos);
+        }
+
+        void visit(const StatementNode&) {}
+
+        void visit(const ForStatementNode&) {}
+
+        void visit(const ForArrayStatementNode& node) {
+            compile_expression(node.condition, node.pos);
+            const auto slot = add_loop_slots(node.value, nullptr);
+            auto loop = emit(OpCode::ForArray, node.pos, slot);
+            auto body = address();
+            scope.emplace_back(node.value, slot);
+            loops.push_back(slot);
+            node.body.accept(*this);
+            loops.pop_back();
+            scope.pop_back();
+            auto next = emit(OpCode::Next, node.pos);
+            program.code[next].target = body;
+            patch(loop);
+        }
+
+        void visit(const ForObjectStatementNode& node) {
+            compile_expression(node.condition, node.pos);
+            const auto slot = add_loop_slots(node.value, &node.key);
+            auto loop = emit(OpCode::ForObject, node.pos, slot);
+            auto body = address();
+            scope.emplace_back(node.value, slot);
+            scope.emplace_back(node.key, slot + 1);
+            loops.push_back(slot);
+            node.body.accept(*this);
+            loops.pop_back();
+            scope.pop_back();
+            scope.pop_back();
+            auto next = emit(OpCode::Next, node.pos);
+            program.code[next].target = body;
+            patch(loop);
+        }
+
+        void visit(const IfStatementNode& node) {
+            compile_expression(node.condition, node.pos);
+            auto jump_false = emit(OpCode::JumpIfFalse, node.pos);
+            node.true_statement.accept(*this);
+            if (node.has_false_statement) {
+                auto jump_end = emit(OpCode::Jump, node.pos);
+                patch(jump_false);
+                node.false_statement.accept(*this);
+                patch(jump_end);
+            } else {
+                patch(jump_false);
+            }
+        }
+
+        void visit(const FileStatementNode& node) {
+            compile_expression(node.filename, node.pos);
+            emit(OpCode::FileBegin, node.pos);
+            node.body.accept(*this);
+            emit(OpCode::FileEnd, node.pos);
+        }
+
+        void visit(const ApplyTemplateStatementNode& node) {
+            emit(OpCode::ApplyTemplate, node.pos, add_template(node.template_name), add_name(node.field_path));
+        }
+
+        void visit(const SetStatementNode& node) {
+            compile_expression(node.expression, node.pos);
+            const auto [name, field] = string_view::split(node.key, '.');
+            const auto slot = set_slot(static_cast<std::string>(name));
+            emit(OpCode::Set, node.pos, slot, add_name(field.empty() ? std::string() : convert_dot_to_ptr(field)));
+        }
+    };
+
+} // namespace Wizard
@@ -23,11 +23,15 @@ namespace Wizard {
         std::string comment_close_force_rstrip {"-#}"};
 
         std::filesystem::path templates_dir;
+
+        bool operator==(const LexerConfig&) const = default;
     };
 
     struct ParserConfig {
         bool parse_nested_template{true};
         bool keep_comments{false}; // add comments in AST
+        // threads parsing nested templates (1 - recursive parsing in place, 0 - all cores)
+        size_t nested_template_jobs{1};
 
         std::function<Template(const std::filesystem::path&, const std::string&)> include_callback;
     };
@@ -37,6 +41,9 @@ namespace Wizard {
         bool dry_run{false}; // only cout output
         bool strict{false}; // json variable must exists or not
         bool throw_at_missing_includes{true};
+        // threads rendering elements of array by apply-template statement (1 - sequential, 0 - all cores)
+        // functions (callbacks) have to be thread-safe if it isn't 1
+        size_t apply_template_jobs{1};
 
         std::string loop_variable_name{"loop"};
     };
@@ -0,0 +1,349 @@
+#pragma once
+#include <map>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <system_error>
+#include <boost/json/parse.hpp>
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+#include "Util.h"
+#include "TextScan.h"
+
+namespace Wizard {
+
+    // Fields of json data which template can read (tree of dot separated paths)
+    // a field is kept whole where a path ends, arrays pass the fields to all elements (like data paths of renderer)
+    // the data file can be parsed lazily: values of other fields are skipped without parsing
+    class DataFilter
+    {
+        struct Field {
+            bool whole{false};
+            std::map<std::string, Field, std::less<>> fields;
+        };
+
+        Field root;
+
+        // field of path (nullptr if it is a part of whole field)
+        Field* find_field(std::string_view path) {
+            Field* field = &root;
+            while(!field->whole && !path.empty()) {
+                std::string_view name;
+                std::tie(name, path) = string_view::split(path, '.');
+                if(name.empty()) {
+                    // reference to self
+                    break;
+                }
+                field = &field->fields[std::string(name)];
+            }
+            return field->whole ? nullptr : field;
+        }
+
+        static void set_whole(Field& field) {
+            field.whole = true;
+            field.fields.clear();
+        }
+
+        static void merge(Field& target, const Field& source) {
+            if(target.whole) {
+                return;
+            }
+            if(source.whole) {
+                set_whole(target);
+                return;
+            }
+            for(const auto& [name, field] : source.fields) {
+                merge(target.fields[name], field);
+            }
+        }
+
+        // array elements are selected by index (pointer of apply-template statement)
+        static bool has_index(const Field& field) {
+            for(const auto& [name, nested] : field.fields) {
+                if(name.find_first_not_of("0123456789") == std::string::npos) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static json::value select(const json::value& value, const Field& field, const json::storage_ptr& storage) {
+            if(value.is_object() && !field.whole) {
+                json::object result(storage);
+                for(const auto& item : value.get_object()) {
+                    const auto it = field.fields.find(std::string_view(item.key()));
+                    if(it != field.fields.end()) {
+                        result.emplace(item.key(), select(item.value(), it->second, storage));
+                    }
+                }
+                return json::value(std::move(result));
+            }
+            if(value.is_array() && !field.whole && !has_index(field)) {
+                json::array result(storage);
+                result.reserve(value.get_array().size());
+                for(const auto& element : value.get_array()) {
+                    result.push_back(select(element, field, storage));
+                }
+                return json::value(std::move(result));
+            }
+            return json::value(value, storage);
+        }
+
+        // scanner of json text: selected values are parsed, the others are only skipped
+        class Reader
+        {
+            std::string_view text;
+            size_t pos{0};
+            const json::storage_ptr& storage;
+            std::error_code& ec;
+
+            void fail() {
+                if(!ec) {
+                    ec = std::make_error_code(std::errc::invalid_argument);
+                }
+                pos = text.size();
+            }
+
+            void skip_whitespace() {
+                while(pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t')) {
+                    ++pos;
+                }
+            }
+
+            bool expect(char c) {
+                skip_whitespace();
+                if(pos < text.size() && text[pos] == c) {
+                    ++pos;
+                    return true;
+                }
+                fail();
+                return false;
+            }
+
+            char peek() {
+                skip_whitespace();
+                return pos < text.size() ? text[pos] : '\0';
+            }
+
+            // pos is at opening quote, returns position of closing quote
+            size_t skip_string() {
+                ++pos;
+                while(pos < text.size()) {
+                    const auto found = text_scan::find_first_of(text.substr(pos), "\"\\");
+                    if(found == std::string_view::npos) {
+                        break;
+                    }
+                    pos += found;
+                    if(text[pos] == '\\') {
+                        pos += 2;
+                        continue;
+                    }
+                    return pos++;
+                }
+                fail();
+                return pos;
+            }
+
+            void skip_value() {
+                skip_whitespace();
+                if(pos >= text.size()) {
+                    fail();
+                    return;
+                }
+                if(text[pos] == '"') {
+                    skip_string();
+                    return;
+                }
+                if(text[pos] != '{' && text[pos] != '[') {
+                    // literal or number
+                    const auto end = text.find_first_of(",]} \n\r\t", pos);
+                    pos = end == std::string_view::npos ? text.size() : end;
+                    return;
+                }
+                size_t depth = 0;
+                while(pos < text.size()) {
+                    const auto found = text_scan::find_first_of(text.substr(pos), "\"{}[]");
+                    if(found == std::string_view::npos) {
+                        break;
+                    }
+                    pos += found;
+                    switch(text[pos]) {
+                    case '"':
+                        skip_string();
+                        continue;
+                    case '{':
+                    case '[':
+                        ++depth;
+                        break;
+                    default:
+                        if(--depth == 0) {
+                            ++pos;
+                            return;
+                        }
+                    }
+                    ++pos;
+                }
+                fail();
+            }
+
+            json::value parse_slice(size_t start) {
+                auto result = json::parse(text.substr(start, pos - start), ec, storage);
+                if(ec) {
+                    pos = text.size();
+                }
+                return result;
+            }
+
+            std::string read_key() {
+                skip_whitespace();
+                if(pos >= text.size() || text[pos] != '"') {
+                    fail();
+                    return {};
+                }
+                const auto start = pos;
+                const auto end = skip_string();
+                const auto key = text.substr(start + 1, end - start - 1);
+                if(key.find('\\') == std::string_view::npos) {
+                    return std::string(key);
+                }
+                // escaped characters
+                std::error_code key_ec;
+                const auto value = json::parse(text.substr(start, pos - start), key_ec);
+                if(key_ec) {
+                    fail();
+                    return {};
+                }
+                return std::string(value.get_string().c_str());
+            }
+
+        public:
+            Reader(std::string_view text, const json::storage_ptr& storage, std::error_code& ec)
+                : text(text), storage(storage), ec(ec) {}
+
+            json::value read(const Field& field) {
+                const char c = peek();
+                if(field.whole || (c != '{' && c != '[') || (c == '[' && has_index(field))) {
+                    const auto start = pos;
+                    skip_value();
+                    return ec ? json::value() : parse_slice(start);
+                }
+                if(c == '{') {
+                    ++pos;
+                    json::object result(storage);
+                    if(peek() == '}') {
+                        ++pos;
+                        return json::value(std::move(result));
+                    }
+                    while(!ec) {
+                        const auto key = read_key();
+                        if(!expect(':')) {
+                            break;
+                        }
+                        const auto it = field.fields.find(key);
+                        if(it != field.fields.end()) {
+                            result.insert_or_assign(key, read(it->second));
+                        } else {
+                            skip_value();
+                        }
+                        if(peek() == ',') {
+                            ++pos;
+                            continue;
+                        }
+                        expect('}');
+                        break;
+                    }
+                    return json::value(std::move(result));
+                }
+                ++pos;
+                json::array result(storage);
+                if(peek() == ']') {
+                    ++pos;
+                    return json::value(std::move(result));
+                }
+                while(!ec) {
+                    result.push_back(read(field));
+                    if(peek() == ',') {
+                        ++pos;
+                        continue;
+                    }
+                    expect(']');
+                    break;
+                }
+                return json::value(std::move(result));
+            }
+
+            json::value read_document(const Field& field) {
+                auto result = read(field);
+                skip_whitespace();
+                if(!ec && pos != text.size()) {
+                    fail();
+                }
+                return ec ? json::value() : std::move(result);
+            }
+        };
+
+    public:
+        // the whole data
+        static DataFilter all() {
+            DataFilter filter;
+            filter.add_all();
+            return filter;
+        }
+
+        void add_all() {
+            set_whole(root);
+        }
+
+        bool is_all() const {
+            return root.whole;
+        }
+
+        bool empty() const {
+            return !root.whole && root.fields.empty();
+        }
+
+        // add field with all its values (dot separated path, empty path - the whole data)
+        void add(std::string_view path) {
+            if(auto field = find_field(path)) {
+                set_whole(*field);
+            }
+        }
+
+        // add fields of other filter under path (data of nested template)
+        void add(std::string_view path, const DataFilter& nested) {
+            if(auto field = find_field(path)) {
+                merge(*field, nested.root);
+            }
+        }
+
+        void merge(const DataFilter& other) {
+            merge(root, other.root);
+        }
+
+        // copy of selected fields
+        json::value apply(const json::value& data, json::storage_ptr storage = {}) const {
+            return select(data, root, storage);
+        }
+
+        // parse selected fields of json text (skipped values aren't validated)
+        json::value parse(std::string_view text, std::error_code& ec, json::storage_ptr storage = {}) const {
+            ec.clear();
+            if(root.whole) {
+                return json::parse(text, ec, std::move(storage));
+            }
+            Reader reader(text, storage, ec);
+            return reader.read_document(root);
+        }
+
+        // parse selected fields of json file (mapped into memory)
+        json::value read_file(const std::filesystem::path& filepath, std::error_code& ec,
+                              json::storage_ptr storage = {}) const {
+            if(root.whole) {
+                return read_json_file(filepath, ec, std::move(storage));
+            }
+            MappedFile file(filepath);
+            return parse(file.view(), ec, std::move(storage));
+        }
+    };
+
+} // namespace Wizard
@@ -12,7 +12,7 @@ namespace json = boost::json;
 namespace Wizard
 {
     struct Variable;
-    using Variables = std::map<std::string, Variable>;
+    using Variables = std::map<std::string, Variable, std::less<>>;
     
     struct Variable
     {
@@ -34,7 +34,7 @@ namespace Wizard
         bool operator==(const Variable &) const = default;
     };
 
-    using Variables = std::map<std::string, Variable>;
+    using Variables = std::map<std::string, Variable, std::less<>>;
     using Templates = std::set<std::filesystem::path>;
 
     struct Description
@@ -55,12 +55,8 @@ namespace Wizard
         static Description load_from_json(const std::string& name, const std::filesystem::path& path)
         {
             std::error_code ec;
-            std::ifstream infile;
-            infile.open(path);
-            if(infile.fail()) {
-                throw FileError("Couldn't open file: \"" + path.string() + "\"");
-            }
-            auto desc = json::parse(infile, ec);
+            // the parsed file is only converted into description
+            auto desc = read_json_file(path, ec, make_json_arena());
             if(ec) {
                 throw FileError(ec.message());
             }
@@ -100,21 +96,25 @@ namespace Wizard
             return obj;
         }
 
-        bool find_variable(const std::string_view& path, Variable& var) const
+        // description of variable by dot separated path (nullptr if it isn't described)
+        const Variable* find_variable(std::string_view path) const
         {
-            auto parts = split_path(path);
             const auto* pvars = &variables;
             const Variable* pvar = nullptr;
-            for(auto& part : parts){
+            do {
+                std::string_view part;
+                std::tie(part, path) = string_view::split(path, '.');
+                if(part.empty()) {
+                    continue;
+                }
                 auto it = pvars->find(part);
                 if(it == pvars->end()) {
-                    return false;
+                    return nullptr;
                 }
                 pvar = &it->second;
                 pvars = &pvar->variables;
-            }
-            var = *pvar;
-            return true;
+            } while(!path.empty());
+            return pvar;
         }
 
         static std::string type_to_string(Variable::Type vtype)
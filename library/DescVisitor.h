@@ -110,4 +110,44 @@ namespace Wizard
         }
 
     };
+
+    // Data paths which template can read (see Environment::data_filter)
+    // fields of apply-template statements are collected separately, nested templates read only them
+    class DataPathVisitor : public DescriptionVisitor
+    {
+        using Op = FunctionStorage::Operation;
+
+    public:
+        std::vector<std::pair<std::string, std::filesystem::path>> applied; // field => nested template
+        bool dynamic_path{false};   // path is computed during render (the whole data may be read)
+
+        using DescriptionVisitor::DescriptionVisitor;
+
+        void populate(const Template& tpl) {
+            applied.clear();
+            dynamic_path = false;
+            DescriptionVisitor::populate(tpl);
+        }
+
+    protected:
+        using DescriptionVisitor::visit;
+
+        void visit(const FunctionNode& node) override {
+            if(node.operation == Op::Exists) {
+                // exists("name") looks the name up in data
+                const auto literal = node.arguments.empty() ? nullptr : dynamic_cast<const LiteralNode*>(node.arguments.front());
+                if(literal && literal->value.is_string()) {
+                    const std::string name(literal->value.get_string().c_str());
+                    description.variables[name] = {name};
+                } else {
+                    dynamic_path = true;
+                }
+            }
+            DescriptionVisitor::visit(node);
+        }
+
+        void visit(const ApplyTemplateStatementNode& node) override {
+            applied.emplace_back(node.field_name, node.template_name);
+        }
+    };
 };
\ No newline at end of file
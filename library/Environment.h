@@ -1,11 +1,18 @@
 #pragma once
+#include <set>
 #include <string>
+#include <vector>
 #include <filesystem>
 #include "Config.h"
 #include "Template.h"
 #include "Parser.h"
 #include "Renderer.h"
 #include "DescVisitor.h"
+#include "DataFilter.h"
+#include "TemplateCache.h"
+#include "TemplateGraph.h"
+#include "TemplateArchive.h"
+#include "FrozenEnvironment.h"
 
 
 namespace Wizard {
@@ -17,27 +24,109 @@ class Environment {
 
   FunctionStorage function_storage;
   TemplateStorage template_storage;
-public:
+  TemplateCache template_cache; // parsed template files
+  TemplateGraph template_graph; // references between parsed templates
 
-    // parse template (default configs)
-    Template parse_file(const std::filesystem::path& path,
-                        const std::filesystem::path& fileinfo = "")
+    // call function with parser (lexer with compile-time delimiters if config has default ones)
+    template <typename Function>
+    auto with_parser(const LexerConfig& lconfig, const ParserConfig& pconfig, Function&& function)
+    {
+        if(is_default_delimiters(lconfig)) {
+            DefaultParser parser(pconfig, lconfig, template_storage, function_storage);
+            return function(parser);
+        }
+        Parser parser(pconfig, lconfig, template_storage, function_storage);
+        return function(parser);
+    }
+
+    // parse template file or take it from cache
+    const Template& cached_file(const std::filesystem::path& path, 
+                                const LexerConfig& lconfig, const ParserConfig& pconfig,
+                                const std::filesystem::path& fileinfo)
     {
-        // parse template
-        Parser parser(parser_config, lexer_config, template_storage, function_storage);
-        Template tpl = parser.parse_file(path);
+        if(auto tpl = template_cache.find(path, fileinfo, lconfig, pconfig)) {
+            return *tpl;
+        }
+        // nested templates changed on disk are parsed again with the template
+        for(const auto& name : template_cache.changed_dependencies(path, fileinfo, lconfig, pconfig)) {
+            template_storage.erase(name);
+        }
+        Template tpl;
+        if(TemplateArchive::is_archive(path)) {
+            // precompiled template
+            tpl = TemplateArchive::load(TemplateCache::file_path(path, lconfig), template_storage, function_storage);
+        } else {
+            // parse template
+            tpl = with_parser(lconfig, pconfig, [&](auto& parser) { return parser.parse_file(path); });
+        }
         if(!fileinfo.empty()) {
             // parse template description
             auto name = path.stem().string();
             tpl.desc = Description::load_from_json(name, fileinfo);
         }
-        return tpl;
+        // nested templates are added into storage by parser
+        template_graph.add(TemplateGraph::template_name(path), tpl);
+        template_graph.add_file(TemplateGraph::template_name(path), path);
+        for(const auto& [name, nested] : template_storage) {
+            template_graph.add(name.lexically_normal(), nested);
+        }
+        // files checked by cache: nested template files (precompiled template contains them) and description
+        std::vector<TemplateCache::Dependency> dependencies;
+        if(!TemplateArchive::is_archive(path)) {
+            for(const auto& name : template_graph.nested(TemplateGraph::template_name(path))) {
+                dependencies.push_back({name, TemplateCache::file_path(name.string() + ".tpl", lconfig)});
+            }
+        }
+        if(!fileinfo.empty()) {
+            dependencies.push_back({{}, fileinfo});
+        }
+        return template_cache.insert(path, fileinfo, lconfig, pconfig, tpl, dependencies);
+    }
+
+    // data fields of template, nested templates are visited once on the path (recursion reads whole field)
+    DataFilter data_filter(const Template& tmpl, std::set<std::filesystem::path>& visiting)
+    {
+        DataPathVisitor visitor(render_config);
+        visitor.populate(tmpl);
+        DataFilter filter;
+        if(visitor.dynamic_path) {
+            filter.add_all();
+            return filter;
+        }
+        for(const auto& [name, variable] : visitor.description.variables) {
+            filter.add(name);
+        }
+        for(const auto& [field, name] : visitor.applied) {
+            const auto it = template_storage.find(name);
+            if(it == template_storage.end() || !visiting.insert(name).second) {
+                filter.add(field);
+                continue;
+            }
+            filter.add(field, data_filter(it->second, visiting));
+            visiting.erase(name);
+        }
+        return filter;
+    }
+
+public:
+
+    // parse template (default configs)
+    Template parse_file(const std::filesystem::path& path,
+                        const std::filesystem::path& fileinfo = "")
+    {
+        return cached_file(path, lexer_config, parser_config, fileinfo);
+    }
+
+    // parsed template file from cache (valid until the cache is cleared)
+    const Template& cached_template(const std::filesystem::path& path,
+                                    const std::filesystem::path& fileinfo = "")
+    {
+        return cached_file(path, lexer_config, parser_config, fileinfo);
     }
 
     Template parse(const std::string_view input)
     {
-        Parser parser(parser_config, lexer_config, template_storage, function_storage);
-        return parser.parse(input);
+        return with_parser(lexer_config, parser_config, [&](auto& parser) { return parser.parse(input); });
     }
 
     // parse template (custom configs)
@@ -45,37 +134,43 @@ public:
                         const LexerConfig& lconfig, const ParserConfig& pconfig,
                         const std::filesystem::path& fileinfo = "")
     {
-        // parse template
-        Parser parser(pconfig, lconfig, template_storage, function_storage);
-        Template tpl = parser.parse_file(path);
-        if(!fileinfo.empty()) {
-            // parse template description
-            auto name = path.stem().string();
-            tpl.desc = Description::load_from_json(name, fileinfo);
-        }
-        return tpl;
+        return cached_file(path, lconfig, pconfig, fileinfo);
     }
 
     Template parse(const std::string_view input,
                   const LexerConfig& lconfig, const ParserConfig& pconfig)
     {
-        Parser parser(pconfig, lconfig, template_storage, function_storage);
-        return parser.parse(input);
+        return with_parser(lconfig, pconfig, [&](auto& parser) { return parser.parse(input); });
     }
 
     // render template
-    std::string render(const Template& tmpl, const json::value& data) {
+    void render(OutputSink& output, const Template& tmpl, const json::value& data) {
     	Renderer renderer(render_config, template_storage, function_storage);
-        std::stringstream os;
-        renderer.render(os, tmpl, data);
-        return os.str();
+        renderer.render(output, tmpl, data);
+    }
+
+    std::string render(const Template& tmpl, const json::value& data) {
+        std::string result;
+        {
+            StringSink output(result);
+            render(output, tmpl, data);
+        }
+        return result;
+    }
+
+    void render_file(OutputSink& output,
+                     const std::filesystem::path& filename, 
+                     const json::value& data, 
+                     const std::filesystem::path& infofile = "") {
+
+        render(output, cached_file(filename, lexer_config, parser_config, infofile), data);
     }
 
     std::string render_file(const std::filesystem::path& filename, 
                             const json::value& data, 
                             const std::filesystem::path& infofile = "") {
 
-        return render(parse_file(filename, infofile), data);
+        return render(cached_file(filename, lexer_config, parser_config, infofile), data);
     }
 
     std::string render(const std::string& text, 
@@ -91,8 +186,7 @@ public:
 
     Template parse_expression(const std::string_view input)
     {
-        Parser parser(parser_config, lexer_config, template_storage, function_storage);
-        return parser.parse_expression(input);
+        return with_parser(lexer_config, parser_config, [&](auto& parser) { return parser.parse_expression(input); });
     }
 
     json::value evaluate(const std::string_view expr, const json::value& data) {
@@ -120,9 +214,70 @@ public:
         return visitor.description;
     }
 
+    // data fields which template (with nested templates) can read, other fields may be skipped by data loader
+    DataFilter data_filter(const Template& tmpl) {
+        std::set<std::filesystem::path> visiting;
+        return data_filter(tmpl, visiting);
+    }
 
+    DataFilter data_filter_file(const std::filesystem::path& path, const std::filesystem::path& fileinfo = "") {
+        return data_filter(cached_file(path, lexer_config, parser_config, fileinfo));
+    }
+
+
+    // save parsed template with nested templates into precompiled file (.wzc)
+    void compile_file(const std::filesystem::path& path, const std::filesystem::path& output,
+                      const std::filesystem::path& fileinfo = "") {
+        const auto& tpl = cached_file(path, lexer_config, parser_config, fileinfo);
+        TemplateArchive::save(output, tpl, template_storage);
+    }
+
+    // drop cached template file and templates using it (next render parses them again)
+    void invalidate_template(const std::filesystem::path& path) {
+        template_cache.invalidate(path, lexer_config);
+        const auto name = TemplateGraph::template_name(path);
+        for(const auto& file : template_graph.files(name)) {
+            template_cache.invalidate(file, lexer_config);
+        }
+        // nested template is referenced by name, parser of parent template adds it into storage again
+        const auto dependents = template_graph.dependents(name);
+        template_storage.erase(name);
+        template_graph.remove(name);
+        for(const auto& dependent : dependents) {
+            for(const auto& file : template_graph.files(dependent)) {
+                template_cache.invalidate(file, lexer_config);
+            }
+            template_storage.erase(dependent);
+            template_graph.remove(dependent);
+        }
+    }
+
+    // drop all parsed templates
+    void clear_template_cache() {
+        template_cache.clear();
+        template_storage.clear();
+        template_graph.clear();
+    }
+
+    // read-only copy of configs, functions and parsed templates for concurrent rendering
+    // files are parsed before freeze (in addition to already cached ones)
+    FrozenEnvironment freeze(const std::vector<std::filesystem::path>& files = {}) {
+        for(const auto& file : files) {
+            cached_file(file, lexer_config, parser_config, "");
+        }
+        std::map<std::filesystem::path, Template> parsed_files;
+        template_cache.for_each([&parsed_files](const std::filesystem::path& file, const Template& tmpl) {
+            parsed_files.insert_or_assign(file, tmpl);
+        });
+        return FrozenEnvironment(std::make_shared<const FrozenEnvironment::State>(FrozenEnvironment::State{
+            lexer_config, render_config, function_storage, template_storage, std::move(parsed_files)}));
+    }
+
+    const TemplateCache& get_template_cache() const { return template_cache; }
+    const TemplateGraph& get_template_graph() const { return template_graph; }
     const TemplateStorage& get_templates() const { return template_storage; }
     const FunctionStorage& get_functions() const { return function_storage; }
+    const RenderConfig& get_render_config() const { return render_config; }
     
     /// Sets the opener and closer for template statements
     void set_statement(const std::string& open, const std::string& close) {
@@ -158,6 +313,11 @@ public:
         lexer_config.templates_dir = dir;
     }
 
+    /// Templates directory
+    const std::filesystem::path& get_template_directory() const {
+        return lexer_config.templates_dir;
+    }
+
     // Set dry run (all output in returned string)
     void set_dry_run(bool dry) {
         render_config.dry_run = dry;
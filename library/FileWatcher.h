@@ -0,0 +1,270 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <thread>
+#include <system_error>
+#include "Exceptions.h"
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Wizard {
+
+    // Changes of files and directories (inotify on Linux, polling of modification time otherwise)
+    class FileWatcher
+    {
+    public:
+        using Paths = std::set<std::filesystem::path>;
+        using Duration = std::chrono::milliseconds;
+
+        // events of one save are collected together (editors write files in several steps)
+        static constexpr Duration settle_time{100};
+
+    private:
+        Paths files;        // watched files
+        Paths directories;  // watched directories (with subdirectories)
+        bool overflow{false}; // events of the last wait were lost
+
+        static std::filesystem::path absolute(const std::filesystem::path& path) {
+            std::error_code ec;
+            auto result = std::filesystem::absolute(path, ec);
+            return (ec ? path : result).lexically_normal();
+        }
+
+        bool is_watched(const std::filesystem::path& path) const {
+            if(files.contains(path)) {
+                return true;
+            }
+            for(const auto& directory : directories) {
+                const auto relative = path.lexically_relative(directory);
+                if(!relative.empty() && *relative.begin() != "..") {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+#ifdef __linux__
+        int fd{-1};
+        std::map<int, std::filesystem::path> watches; // watch descriptor => directory
+
+        // subdirectory may be removed before it is watched (temporary directories of editors and builds)
+        void watch_directory(const std::filesystem::path& directory, bool required) {
+            const int wd = inotify_add_watch(fd, directory.c_str(),
+                                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+            if(wd < 0) {
+                if(!required && (errno == ENOENT || errno == ENOTDIR)) {
+                    return;
+                }
+                throw FileError("Couldn't watch directory: \"" + directory.string() + "\"");
+            }
+            watches[wd] = directory;
+        }
+
+        void watch_tree(const std::filesystem::path& directory, bool required) {
+            watch_directory(directory, required);
+            std::error_code ec;
+            for(auto it = std::filesystem::recursive_directory_iterator(directory, ec);
+                !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                std::error_code type_ec;
+                if(it->is_directory(type_ec)) {
+                    watch_directory(it->path(), false);
+                }
+            }
+        }
+
+        // wait for events, interrupted wait continues with the rest of timeout
+        bool poll_events(int timeout) {
+            const auto deadline = std::chrono::steady_clock::now() + Duration{timeout};
+            pollfd pfd{fd, POLLIN, 0};
+            for(;;) {
+                const int ready = poll(&pfd, 1, timeout);
+                if(ready >= 0 || errno != EINTR) {
+                    return ready > 0;
+                }
+                if(timeout > 0) {
+                    const auto rest = std::chrono::duration_cast<Duration>(deadline - std::chrono::steady_clock::now());
+                    timeout = static_cast<int>(std::max<Duration::rep>(rest.count(), 0));
+                }
+            }
+        }
+
+        // read available events, false if there are no events during timeout (negative - infinite)
+        bool read_events(int timeout, Paths& changed) {
+            if(!poll_events(timeout)) {
+                return false;
+            }
+            alignas(inotify_event) char buffer[16 * 1024];
+            ssize_t size;
+            do {
+                size = read(fd, buffer, sizeof(buffer));
+            } while(size < 0 && errno == EINTR);
+            if(size <= 0) {
+                return false;
+            }
+            for(ssize_t pos = 0; pos < size;) {
+                const auto event = reinterpret_cast<const inotify_event*>(buffer + pos);
+                pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                if((event->mask & IN_Q_OVERFLOW) != 0) {
+                    // events are lost: everything may be changed
+                    overflow = true;
+                    changed.insert(files.begin(), files.end());
+                    changed.insert(directories.begin(), directories.end());
+                    // subdirectories created meanwhile
+                    std::error_code ec;
+                    for(const auto& directory : directories) {
+                        if(std::filesystem::is_directory(directory, ec)) {
+                            watch_tree(directory, false);
+                        }
+                    }
+                    continue;
+                }
+                const auto it = watches.find(event->wd);
+                if(it == watches.end() || event->len == 0) {
+                    continue;
+                }
+                const auto path = it->second / event->name;
+                if(!is_watched(path)) {
+                    continue;
+                }
+                if((event->mask & IN_ISDIR) != 0) {
+                    if((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                        // new subdirectory of watched directory
+                        watch_tree(path, false);
+                    }
+                    continue;
+                }
+                changed.insert(path);
+            }
+            return true;
+        }
+
+    public:
+        FileWatcher() {
+            fd = inotify_init1(IN_CLOEXEC);
+            if(fd < 0) {
+                throw FileError("Couldn't initialize file watcher");
+            }
+        }
+
+        ~FileWatcher() {
+            close(fd);
+        }
+
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+
+        void add_file(const std::filesystem::path& path) {
+            const auto file = absolute(path);
+            files.insert(file);
+            // the file may be replaced by editor, so its directory is watched
+            watch_directory(file.parent_path(), true);
+        }
+
+        void add_directory(const std::filesystem::path& path) {
+            const auto directory = absolute(path);
+            directories.insert(directory);
+            watch_tree(directory, true);
+        }
+
+        // changed files, empty if there are no changes during timeout (negative - infinite)
+        // after lost events (see overflowed) all watched files and directories are returned
+        Paths wait(Duration timeout = Duration{-1}) {
+            Paths changed;
+            overflow = false;
+            while(changed.empty()) {
+                if(!read_events(static_cast<int>(timeout.count()), changed)) {
+                    return changed;
+                }
+            }
+            while(read_events(static_cast<int>(settle_time.count()), changed)) {
+            }
+            return changed;
+        }
+#else
+        static constexpr Duration poll_interval{500};
+
+        std::map<std::filesystem::path, std::filesystem::file_time_type> times;
+
+        std::map<std::filesystem::path, std::filesystem::file_time_type> snapshot() const {
+            std::map<std::filesystem::path, std::filesystem::file_time_type> result;
+            std::error_code ec;
+            for(const auto& file : files) {
+                const auto time = std::filesystem::last_write_time(file, ec);
+                if(!ec) {
+                    result[file] = time;
+                }
+            }
+            for(const auto& directory : directories) {
+                for(auto it = std::filesystem::recursive_directory_iterator(directory, ec);
+                    !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                    std::error_code file_ec;
+                    if(it->is_regular_file(file_ec)) {
+                        result[it->path().lexically_normal()] = it->last_write_time(file_ec);
+                    }
+                }
+            }
+            return result;
+        }
+
+        Paths changes() {
+            auto current = snapshot();
+            Paths changed;
+            for(const auto& [path, time] : current) {
+                const auto it = times.find(path);
+                if(it == times.end() || it->second != time) {
+                    changed.insert(path);
+                }
+            }
+            for(const auto& [path, time] : times) {
+                if(!current.contains(path)) {
+                    changed.insert(path);
+                }
+            }
+            times = std::move(current);
+            return changed;
+        }
+
+    public:
+        void add_file(const std::filesystem::path& path) {
+            files.insert(absolute(path));
+            times = snapshot();
+        }
+
+        void add_directory(const std::filesystem::path& path) {
+            directories.insert(absolute(path));
+            times = snapshot();
+        }
+
+        // changed files, empty if there are no changes during timeout (negative - infinite)
+        Paths wait(Duration timeout = Duration{-1}) {
+            overflow = false;
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            for(;;) {
+                auto changed = changes();
+                if(!changed.empty()) {
+                    std::this_thread::sleep_for(settle_time);
+                    changed.merge(changes());
+                    return changed;
+                }
+                if(timeout.count() >= 0 && std::chrono::steady_clock::now() >= deadline) {
+                    return changed;
+                }
+                std::this_thread::sleep_for(poll_interval);
+            }
+        }
+#endif
+
+        // events of the last wait were lost (queue overflow), the caller has to reload everything
+        bool overflowed() const {
+            return overflow;
+        }
+    };
+
+} // namespace Wizard
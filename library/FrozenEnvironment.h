@@ -0,0 +1,86 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include "Config.h"
+#include "Exceptions.h"
+#include "Template.h"
+#include "Renderer.h"
+#include "Output.h"
+#include "TemplateCache.h"
+
+namespace Wizard {
+
+// Read-only snapshot of Environment (see Environment::freeze)
+// templates, functions and configs are shared and never changed, so any number of threads
+// may render at once without locks (callbacks have to be thread-safe)
+class FrozenEnvironment {
+public:
+    struct State {
+        LexerConfig lexer_config;
+        RenderConfig render_config;
+        FunctionStorage function_storage;
+        TemplateStorage template_storage;                   // nested templates
+        std::map<std::filesystem::path, Template> files;    // parsed template files (full normalized path)
+    };
+
+private:
+    std::shared_ptr<const State> state;
+
+public:
+    explicit FrozenEnvironment(std::shared_ptr<const State> state) : state(std::move(state)) {}
+
+    // parsed template file (only files parsed before freeze)
+    const Template& get_file(const std::filesystem::path& path) const {
+        const auto it = state->files.find(TemplateCache::file_path(path, state->lexer_config));
+        if(it == state->files.end()) {
+            throw FileError("template file isn't parsed before freeze: \"" + path.string() + "\"");
+        }
+        return it->second;
+    }
+
+    bool contains_file(const std::filesystem::path& path) const {
+        return state->files.contains(TemplateCache::file_path(path, state->lexer_config));
+    }
+
+    // render template
+    void render(OutputSink& output, const Template& tmpl, const json::value& data) const {
+        render(output, tmpl, data, state->render_config);
+    }
+
+    // render template with own config (e.g. output directory of every thread)
+    void render(OutputSink& output, const Template& tmpl, const json::value& data, const RenderConfig& config) const {
+        Renderer renderer(config, state->template_storage, state->function_storage);
+        renderer.render(output, tmpl, data);
+    }
+
+    std::string render(const Template& tmpl, const json::value& data) const {
+        std::string result;
+        {
+            StringSink output(result);
+            render(output, tmpl, data);
+        }
+        return result;
+    }
+
+    void render_file(OutputSink& output, const std::filesystem::path& path, const json::value& data) const {
+        render(output, get_file(path), data);
+    }
+
+    std::string render_file(const std::filesystem::path& path, const json::value& data) const {
+        return render(get_file(path), data);
+    }
+
+    // evaluate expression
+    json::value evaluate_expression(const Template& tmpl, const json::value& data) const {
+        Renderer renderer(state->render_config, state->template_storage, state->function_storage);
+        return renderer.evaluate_expression(tmpl, data);
+    }
+
+    const TemplateStorage& get_templates() const { return state->template_storage; }
+    const FunctionStorage& get_functions() const { return state->function_storage; }
+    const RenderConfig& get_render_config() const { return state->render_config; }
+};
+
+} // namespace Wizard
@@ -55,11 +55,12 @@ namespace Wizard
             parse_rules(env, rules_, jvrules);
         }
     
-        json::value transform(const json::value& value) const
+        // the result is allocated by storage (e.g. arena of one render)
+        json::value transform(const json::value& value, json::storage_ptr storage = {}) const
         {
             // process rules
             Environment env;
-            json::value result(json::object_kind);
+            json::value result(json::object_kind, std::move(storage));
             transform_value(env, rules_, value, result);
             return result;
         }
@@ -95,7 +96,7 @@ namespace Wizard
                 // sub rules
                 transform_value(env, rule.rules, value, result);
             } else {
-                // simple transform 
+                // simple transform (copied into storage of result)
                 result = value;
             }
         }                        
@@ -108,6 +109,8 @@ namespace Wizard
                 return;
             }
 
+            // new values are created by storage of result, so they are moved without copies
+            const auto& storage = result.storage();
             json::value expr_value;
             for(const auto& rule : rules) {
                 std::vector<const json::value*> old_values;
@@ -124,30 +127,30 @@ namespace Wizard
                 if(old_values.empty()) {
                     continue;
                 }
-                json::value new_values(json::array_kind);
+                json::value new_values(json::array_kind, storage);
                 for(const auto& old_value : old_values) {
-                    json::value new_value(json::array_kind);
+                    json::value new_value(json::array_kind, storage);
                     if(old_value->is_array()) {
                         for(const auto& jv : old_value->as_array()) {
-                            json::value new_value_obj(json::object_kind);
+                            json::value new_value_obj(json::object_kind, storage);
                             transform_value(env, rule, jv, new_value_obj);
                             if (!new_value_obj.as_object().empty()) {
-                                new_value.as_array().push_back(new_value_obj);
+                                new_value.as_array().push_back(std::move(new_value_obj));
                             }
                         }
                     } else {
-                        json::value new_value_obj(json::object_kind);
+                        json::value new_value_obj(json::object_kind, storage);
                         transform_value(env, rule, *old_value, new_value_obj);
-                        new_value = new_value_obj;
+                        new_value = std::move(new_value_obj);
                     }
                     if(old_values.size() > 1) {
-                        new_values.as_array().push_back(new_value);
+                        new_values.as_array().push_back(std::move(new_value));
                     } else {
-                        new_values = new_value;
+                        new_values = std::move(new_value);
                     }
                 }
                 auto to_path = rule.to.empty() ? rule.from : rule.to;
-                result.set_at_pointer(convert_dot_to_ptr(to_path), new_values);
+                result.set_at_pointer(convert_dot_to_ptr(to_path), std::move(new_values));
             }
         }
     
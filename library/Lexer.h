@@ -2,12 +2,86 @@
 #include <unordered_map>
 #include "Util.h"
 #include "Token.h"
+#include "TextScan.h"
 //#include "Parser.h"
 
 namespace Wizard {
 
+	// delimiters from the lexer configuration (custom delimiters)
+	class ConfigDelimiters
+	{
+		const LexerConfig &config;
+		std::string first_chars; // first characters of open sequences
+
+	public:
+		explicit ConfigDelimiters(const LexerConfig &config) : config(config)
+		{
+			for (auto open : {line_statement(), statement_open(), statement_open_force_lstrip(),
+			                  expression_open(), expression_open_force_lstrip(),
+			                  comment_open(), comment_open_force_lstrip()}) {
+				if (!open.empty() && first_chars.find(open[0]) == std::string::npos) {
+					first_chars += open[0];
+				}
+			}
+		}
+
+		std::string_view statement_open() const { return config.statement_open; }
+		std::string_view statement_open_force_lstrip() const { return config.statement_open_force_lstrip; }
+		std::string_view statement_close() const { return config.statement_close; }
+		std::string_view statement_close_force_rstrip() const { return config.statement_close_force_rstrip; }
+		std::string_view line_statement() const { return config.line_statement; }
+		std::string_view expression_open() const { return config.expression_open; }
+		std::string_view expression_open_force_lstrip() const { return config.expression_open_force_lstrip; }
+		std::string_view expression_close() const { return config.expression_close; }
+		std::string_view expression_close_force_rstrip() const { return config.expression_close_force_rstrip; }
+		std::string_view comment_open() const { return config.comment_open; }
+		std::string_view comment_open_force_lstrip() const { return config.comment_open_force_lstrip; }
+		std::string_view comment_close() const { return config.comment_close; }
+		std::string_view comment_close_force_rstrip() const { return config.comment_close_force_rstrip; }
+		std::string_view open_chars() const { return first_chars; }
+	};
 
-	class Lexer
+	// default delimiters known at compile time (the same as LexerConfig defaults)
+	struct DefaultDelimiters
+	{
+		explicit DefaultDelimiters(const LexerConfig &) {}
+
+		static constexpr std::string_view statement_open() { return "{%"; }
+		static constexpr std::string_view statement_open_force_lstrip() { return "{%-"; }
+		static constexpr std::string_view statement_close() { return "%}"; }
+		static constexpr std::string_view statement_close_force_rstrip() { return "-%}"; }
+		static constexpr std::string_view line_statement() { return "##"; }
+		static constexpr std::string_view expression_open() { return "{{"; }
+		static constexpr std::string_view expression_open_force_lstrip() { return "{{-"; }
+		static constexpr std::string_view expression_close() { return "}}"; }
+		static constexpr std::string_view expression_close_force_rstrip() { return "-}}"; }
+		static constexpr std::string_view comment_open() { return "{#"; }
+		static constexpr std::string_view comment_open_force_lstrip() { return "{#-"; }
+		static constexpr std::string_view comment_close() { return "#}"; }
+		static constexpr std::string_view comment_close_force_rstrip() { return "-#}"; }
+		static constexpr std::string_view open_chars() { return "#{"; }
+	};
+
+	// config has unmodified delimiters, DefaultLexer can be used
+	inline bool is_default_delimiters(const LexerConfig &config)
+	{
+		return config.statement_open == DefaultDelimiters::statement_open() &&
+		       config.statement_open_force_lstrip == DefaultDelimiters::statement_open_force_lstrip() &&
+		       config.statement_close == DefaultDelimiters::statement_close() &&
+		       config.statement_close_force_rstrip == DefaultDelimiters::statement_close_force_rstrip() &&
+		       config.line_statement == DefaultDelimiters::line_statement() &&
+		       config.expression_open == DefaultDelimiters::expression_open() &&
+		       config.expression_open_force_lstrip == DefaultDelimiters::expression_open_force_lstrip() &&
+		       config.expression_close == DefaultDelimiters::expression_close() &&
+		       config.expression_close_force_rstrip == DefaultDelimiters::expression_close_force_rstrip() &&
+		       config.comment_open == DefaultDelimiters::comment_open() &&
+		       config.comment_open_force_lstrip == DefaultDelimiters::comment_open_force_lstrip() &&
+		       config.comment_close == DefaultDelimiters::comment_close() &&
+		       config.comment_close_force_rstrip == DefaultDelimiters::comment_close_force_rstrip();
+	}
+
+	template <typename Delimiters>
+	class BasicLexer
 	{
 	public:
 		enum class State
@@ -45,7 +119,7 @@ namespace Wizard {
 	protected:
 
 		const LexerConfig &config;
-		std::string open_chars;
+		const Delimiters delimiters;
 
 		LexerState scan_body(LexerState& state, 
 							 std::string_view close, Token::Kind closeKind, 
@@ -302,27 +376,6 @@ namespace Wizard {
 			return result;
 		}
 
-        void set_open_chars()
-        {
-            open_chars = "";
-            if (open_chars.find(config.line_statement[0]) == std::string::npos) {
-                open_chars += config.line_statement[0];
-            } if (open_chars.find(config.statement_open[0]) == std::string::npos) {
-                open_chars += config.statement_open[0];
-            } if (open_chars.find(config.statement_open_force_lstrip[0]) == std::string::npos) {
-                open_chars += config.statement_open_force_lstrip[0];
-            } if (open_chars.find(config.expression_open[0]) == std::string::npos) {
-                open_chars += config.expression_open[0];
-            } if (open_chars.find(config.expression_open_force_lstrip[0]) == std::string::npos) {
-                open_chars += config.expression_open_force_lstrip[0];
-            } if (open_chars.find(config.comment_open[0]) == std::string::npos) {
-                open_chars += config.comment_open[0];
-            } if (open_chars.find(config.comment_open_force_lstrip[0]) == std::string::npos) {
-                open_chars += config.comment_open_force_lstrip[0];
-            }
-        }
-
-
 		LexerState scan_text(LexerState& state)
 		{
 			state.tok_start = state.pos;
@@ -332,7 +385,7 @@ namespace Wizard {
 				return state;
 			}
 			// fast-scan to first open character
-			const size_t open_start = state.m_in.substr(state.pos).find_first_of(open_chars);
+			const size_t open_start = text_scan::find_first_of(state.m_in.substr(state.pos), delimiters.open_chars());
 			if (open_start == std::string_view::npos) {
 				// didn't find open, return remaining text as text token
 				state.pos = state.m_in.size();
@@ -344,29 +397,29 @@ namespace Wizard {
 			// try to match one of the opening sequences, and get the close
 			std::string_view open_str = state.m_in.substr(state.pos);
 			bool must_lstrip = false;
-			if(open_str.starts_with(config.expression_open)) {
-				if (open_str.starts_with(config.expression_open_force_lstrip)) {
+			if(open_str.starts_with(delimiters.expression_open())) {
+				if (open_str.starts_with(delimiters.expression_open_force_lstrip())) {
 					state.state = State::ExpressionStartForceLstrip;
 					must_lstrip = true;
 				} else {
 					state.state = State::ExpressionStart;
 				}
-			} else if(open_str.starts_with(config.statement_open)) {
-				if (open_str.starts_with(config.statement_open_force_lstrip)) {
+			} else if(open_str.starts_with(delimiters.statement_open())) {
+				if (open_str.starts_with(delimiters.statement_open_force_lstrip())) {
 					state.state = State::StatementStartForceLstrip;
 					must_lstrip = true;
 				} else {
 					state.state = State::StatementStart;
 				}
-			} else if(open_str.starts_with(config.comment_open)) {
-				if (open_str.starts_with(config.comment_open_force_lstrip)) {
+			} else if(open_str.starts_with(delimiters.comment_open())) {
+				if (open_str.starts_with(delimiters.comment_open_force_lstrip())) {
 					state.state = State::CommentStartForceLstrip;
 					must_lstrip = true;
 				} else {
 					state.state = State::CommentStart;
 				}
 			} else if((state.pos == 0 || state.m_in[state.pos - 1] == '\n') && 
-			           open_str.starts_with(config.line_statement)) {
+			           open_str.starts_with(delimiters.line_statement())) {
 				state.state = State::LineStart;
 			} else {
 				state.pos += 1; // wasn't actually an opening sequence
@@ -396,7 +449,7 @@ namespace Wizard {
 				return state;
 			}
 			// fast-scan to comment close
-			const size_t end = state.m_in.substr(state.pos).find(config.comment_close);
+			const size_t end = state.m_in.substr(state.pos).find(delimiters.comment_close());
 			if (end == std::string_view::npos) {
 				state.pos = state.m_in.size();
 				state.token = make_token(state, Token::Kind::Eof);
@@ -404,11 +457,11 @@ namespace Wizard {
 			}
 
 			// Check for trim pattern
-			const bool must_rstrip = state.m_in.substr(state.pos + end - 1).starts_with(config.comment_close_force_rstrip);
+			const bool must_rstrip = state.m_in.substr(state.pos + end - 1).starts_with(delimiters.comment_close_force_rstrip());
 
 			// return the entire comment in the close token
 			state.state = State::Text;
-			state.pos += end + config.comment_close.size();
+			state.pos += end + delimiters.comment_close().size();
 			state.token = make_token(state, Token::Kind::CommentClose);
 
 			if (must_rstrip) {
@@ -428,8 +481,8 @@ namespace Wizard {
 		}
 
 	public:
-		explicit Lexer(const LexerConfig &config) 
-				: config(config) {}
+		explicit BasicLexer(const LexerConfig &config) 
+				: config(config), delimiters(config) {}
 
 
 		SourceLocation current_position(LexerState& state) const {
@@ -439,7 +492,6 @@ namespace Wizard {
 		LexerState start(std::string_view input)
 		{
 			LexerState state{input};
-			set_open_chars();
 			// Consume byte order mark (BOM) for UTF-8
 			if(state.m_in.starts_with("\xEF\xBB\xBF")) {
 				state.m_in = state.m_in.substr(3);
@@ -461,25 +513,25 @@ namespace Wizard {
 			case State::Text:
 				return scan_text(state);
 			case State::ExpressionStart: // {{
-				return new_state(state, State::ExpressionBody, config.expression_open.size(), Token::Kind::ExpressionOpen);
+				return new_state(state, State::ExpressionBody, delimiters.expression_open().size(), Token::Kind::ExpressionOpen);
 			case State::ExpressionStartForceLstrip: // {{-
-				return new_state(state, State::ExpressionBody, config.expression_open_force_lstrip.size(), Token::Kind::ExpressionOpen);
+				return new_state(state, State::ExpressionBody, delimiters.expression_open_force_lstrip().size(), Token::Kind::ExpressionOpen);
 			case State::LineStart: // ##
-				return new_state(state, State::LineBody, config.line_statement.size(), Token::Kind::LineStatementOpen);
+				return new_state(state, State::LineBody, delimiters.line_statement().size(), Token::Kind::LineStatementOpen);
 			case State::StatementStart: // {%
-				return new_state(state, State::StatementBody, config.statement_open.size(), Token::Kind::StatementOpen);
+				return new_state(state, State::StatementBody, delimiters.statement_open().size(), Token::Kind::StatementOpen);
 			case State::StatementStartForceLstrip: // {%-
-				return new_state(state, State::StatementBody, config.statement_open_force_lstrip.size(), Token::Kind::StatementOpen);
+				return new_state(state, State::StatementBody, delimiters.statement_open_force_lstrip().size(), Token::Kind::StatementOpen);
 			case State::CommentStart: // {#
-				return new_state(state, State::CommentBody, config.comment_open.size(), Token::Kind::CommentOpen);
+				return new_state(state, State::CommentBody, delimiters.comment_open().size(), Token::Kind::CommentOpen);
 			case State::CommentStartForceLstrip: // {#-
-				return new_state(state, State::CommentBody, config.comment_open_force_lstrip.size(), Token::Kind::CommentOpen);
+				return new_state(state, State::CommentBody, delimiters.comment_open_force_lstrip().size(), Token::Kind::CommentOpen);
 			case State::ExpressionBody:
-				return scan_body(state, config.expression_close, Token::Kind::ExpressionClose, config.expression_close_force_rstrip);
+				return scan_body(state, delimiters.expression_close(), Token::Kind::ExpressionClose, delimiters.expression_close_force_rstrip());
 			case State::LineBody:
 				return scan_body(state, "\n", Token::Kind::LineStatementClose);
 			case State::StatementBody:
-				return scan_body(state, config.statement_close, Token::Kind::StatementClose, config.statement_close_force_rstrip);
+				return scan_body(state, delimiters.statement_close(), Token::Kind::StatementClose, delimiters.statement_close_force_rstrip());
 			case State::CommentBody:
 				return scan_comment(state);
 			}
@@ -493,6 +545,11 @@ namespace Wizard {
 	
 	};
 
+	// lexer for custom delimiters
+	using Lexer = BasicLexer<ConfigDelimiters>;
+	// lexer for the default delimiters (without delimiters compares at runtime)
+	using DefaultLexer = BasicLexer<DefaultDelimiters>;
+
     inline auto make_scanner(const LexerConfig& config) {
         auto scanner = [&config](std::string_view input) -> Scanner<Token> {
             Lexer lexer(config);
@@ -1,9 +1,10 @@
 #pragma once
 #include <memory>
+#include <memory_resource>
 #include <vector>
 #include <string>
 #include <string_view>
-#include <tuple>
+#include <array>
 #include <boost/json/parse.hpp>
 #include <boost/json/value.hpp>
 namespace json = boost::json;
@@ -63,10 +64,38 @@ namespace Wizard
         virtual ~AstNode() {}
     };
 
+    // Owns all nodes of a template: nodes are bump allocated and released together
+    class NodeArena
+    {
+        std::pmr::monotonic_buffer_resource resource;
+        std::vector<AstNode*> nodes; // in creation order
+
+    public:
+        NodeArena() = default;
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+
+        ~NodeArena() {
+            for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+                (*it)->~AstNode();
+            }
+        }
+
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            void* memory = resource.allocate(sizeof(T), alignof(T));
+            T* node = new (memory) T(std::forward<Args>(args)...);
+            nodes.push_back(node);
+            return node;
+        }
+
+        size_t size() const { return nodes.size(); }
+    };
+
     class BlockNode : public AstNode
     {
     public:
-        std::vector<std::shared_ptr<AstNode>> nodes;
+        std::vector<AstNode*> nodes; // owned by NodeArena
 
         explicit BlockNode() : AstNode(0) {}
 
@@ -132,12 +161,23 @@ namespace Wizard
     public:
         const std::string name;
         //const std::string path;
-        const std::vector<std::string> parts;
+        const std::vector<std::string> parts; // name split by dots
 
         explicit DataNode(std::string_view ptr_name, size_t pos) 
-            : ExpressionNode(pos), name(ptr_name)/*, 
+            : ExpressionNode(pos), name(ptr_name), parts(split_path(ptr_name))/*, 
               path(convert_dot_to_ptr(ptr_name))*/ {}
 
+        static std::vector<std::string> split_path(std::string_view ptr_name)
+        {
+            std::vector<std::string> result;
+            while (!ptr_name.empty()) {
+                std::string_view part;
+                std::tie(part, ptr_name) = string_view::split(ptr_name, '.');
+                result.emplace_back(part);
+            }
+            return result;
+        }
+
         void accept(NodeVisitor &v) const
         {
             v.visit(*this);
@@ -157,45 +197,49 @@ namespace Wizard
 
         std::string name;
         int number_args; // Can also be negative -> -1 for unknown number
-        std::vector<std::shared_ptr<ExpressionNode>> arguments;
+        std::vector<ExpressionNode*> arguments; // owned by NodeArena
         CallbackFunction callback;
 
-        // Op => {number_args, precedence, associativity}
-      	const std::map<Op, std::tuple<int, int, Associativity>> operation_info = {
-            {Op::Not, {1, 4, Associativity::Left}},
-            {Op::And, {2, 1, Associativity::Left}},
-            {Op::Or,  {2, 1, Associativity::Left}},
-            {Op::In,  {2, 2, Associativity::Left}},
-            {Op::Equal, {2, 2, Associativity::Left}},
-            {Op::NotEqual, {2, 2, Associativity::Left}},
-            {Op::Greater, {2, 2, Associativity::Left}},
-            {Op::GreaterEqual, {2, 2, Associativity::Left}},
-            {Op::Less, {2, 2, Associativity::Left}},
-            {Op::LessEqual, {2, 2, Associativity::Left}},
-            {Op::Add, {2, 3, Associativity::Left}},
-            {Op::Subtract, {2, 3, Associativity::Left}},
-            {Op::Multiplication, {2, 4, Associativity::Left}},
-            {Op::Division, {2, 4, Associativity::Left}},
-            {Op::Power, {2, 5, Associativity::Right}},
-            {Op::Modulo, {2, 4, Associativity::Left}},
-            {Op::AtId, {2, 8, Associativity::Left}}
+        struct OperationInfo {
+            int number_args;
+            unsigned int precedence;
+            Associativity associativity;
         };
 
+        // Op => {number_args, precedence, associativity} (not operators have defaults)
+        static constexpr auto operation_info = [] {
+            std::array<OperationInfo, static_cast<size_t>(Op::None) + 1> info{};
+            info.fill({1, 1, Associativity::Left});
+            info[static_cast<size_t>(Op::Not)] = {1, 4, Associativity::Left};
+            info[static_cast<size_t>(Op::And)] = {2, 1, Associativity::Left};
+            info[static_cast<size_t>(Op::Or)] = {2, 1, Associativity::Left};
+            info[static_cast<size_t>(Op::In)] = {2, 2, Associativity::Left};
+            info[static_cast<size_t>(Op::Equal)] = {2, 2, Associativity::Left};
+            info[static_cast<size_t>(Op::NotEqual)] = {2, 2, Associativity::Left};
+            info[static_cast<size_t>(Op::Greater)] = {2, 2, Associativity::Left};
+            info[static_cast<size_t>(Op::GreaterEqual)] = {2, 2, Associativity::Left};
+            info[static_cast<size_t>(Op::Less)] = {2, 2, Associativity::Left};
+            info[static_cast<size_t>(Op::LessEqual)] = {2, 2, Associativity::Left};
+            info[static_cast<size_t>(Op::Add)] = {2, 3, Associativity::Left};
+            info[static_cast<size_t>(Op::Subtract)] = {2, 3, Associativity::Left};
+            info[static_cast<size_t>(Op::Multiplication)] = {2, 4, Associativity::Left};
+            info[static_cast<size_t>(Op::Division)] = {2, 4, Associativity::Left};
+            info[static_cast<size_t>(Op::Power)] = {2, 5, Associativity::Right};
+            info[static_cast<size_t>(Op::Modulo)] = {2, 4, Associativity::Left};
+            info[static_cast<size_t>(Op::AtId)] = {2, 8, Associativity::Left};
+            return info;
+        }();
+
 
         explicit FunctionNode(std::string_view name, size_t pos)
             : ExpressionNode(pos), precedence(8), associativity(Associativity::Left), operation(Op::Callback), name(name), number_args(0) {}
             
-        explicit FunctionNode(Op operation, size_t pos) : ExpressionNode(pos), operation(operation), number_args(1)
-        {
-            precedence = 1;
-            associativity = Associativity::Left;
-            auto it = operation_info.find(operation);
-            if(it != operation_info.end()) {
-                number_args = std::get<0>(it->second); 
-                precedence = std::get<1>(it->second); 
-                associativity = std::get<2>(it->second); 
-            }
-        }
+        explicit FunctionNode(Op operation, size_t pos) 
+            : ExpressionNode(pos), 
+              precedence(operation_info[static_cast<size_t>(operation)].precedence), 
+              associativity(operation_info[static_cast<size_t>(operation)].associativity), 
+              operation(operation), 
+              number_args(operation_info[static_cast<size_t>(operation)].number_args) {}
 
         void accept(NodeVisitor &v) const
         {
@@ -208,7 +252,7 @@ namespace Wizard
     class ExpressionWrapperNode : public AstNode
     {
     public:
-        std::shared_ptr<ExpressionNode> root;
+        ExpressionNode* root{nullptr}; // owned by NodeArena
 
         explicit ExpressionWrapperNode() : AstNode(0) {}
         explicit ExpressionWrapperNode(size_t pos) : AstNode(pos) {}
@@ -0,0 +1,236 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "Exceptions.h"
+
+namespace Wizard {
+
+    // Destination of rendered text
+    // writes are copied into the buffer, sink is called only when the buffer is full
+    class OutputSink
+    {
+    protected:
+        char* buffer_begin{nullptr};
+        char* buffer_pos{nullptr};
+        char* buffer_end{nullptr};
+
+        void set_buffer(char* begin, char* pos, char* end) {
+            buffer_begin = begin;
+            buffer_pos = pos;
+            buffer_end = end;
+        }
+
+        // buffer hasn't enough space for data
+        virtual void overflow(const char* data, size_t size) = 0;
+
+    public:
+        OutputSink() = default;
+        OutputSink(const OutputSink&) = delete;
+        OutputSink& operator=(const OutputSink&) = delete;
+        virtual ~OutputSink() = default;
+
+        void write(const char* data, size_t size) {
+            if(static_cast<size_t>(buffer_end - buffer_pos) >= size) {
+                if(size != 0) {
+                    std::memcpy(buffer_pos, data, size);
+                    buffer_pos += size;
+                }
+            } else {
+                overflow(data, size);
+            }
+        }
+
+        void write(std::string_view text) {
+            write(text.data(), text.size());
+        }
+
+        void put(char c) {
+            if(buffer_pos != buffer_end) {
+                *buffer_pos++ = c;
+            } else {
+                overflow(&c, 1);
+            }
+        }
+
+        // pass buffered data to the destination
+        virtual void flush() {}
+    };
+
+    // Appends to string (the string is the buffer, result isn't copied)
+    class StringSink : public OutputSink
+    {
+        static constexpr size_t min_capacity = 4096;
+
+        std::string& output;
+
+        void overflow(const char* data, size_t size) override {
+            const size_t used = static_cast<size_t>(buffer_pos - output.data());
+            output.resize(std::max({output.size() * 2, used + size, min_capacity}));
+            std::memcpy(output.data() + used, data, size);
+            set_buffer(output.data(), output.data() + used + size, output.data() + output.size());
+        }
+
+    public:
+        explicit StringSink(std::string& output) : output(output) {
+            const size_t used = output.size();
+            set_buffer(output.data(), output.data() + used, output.data() + used);
+        }
+
+        ~StringSink() override {
+            flush();
+        }
+
+        // cut unused space of the string
+        void flush() override {
+            const size_t used = static_cast<size_t>(buffer_pos - output.data());
+            output.resize(used);
+            set_buffer(output.data(), output.data() + used, output.data() + used);
+        }
+    };
+
+    // Fixed buffer, data is passed to the destination by large blocks
+    class BufferedSink : public OutputSink
+    {
+        std::unique_ptr<char[]> buffer;
+        size_t capacity;
+
+        void overflow(const char* data, size_t size) override {
+            flush_buffer();
+            if(size >= capacity) {
+                // too large to buffer
+                write_out(data, size);
+            } else {
+                std::memcpy(buffer_pos, data, size);
+                buffer_pos += size;
+            }
+        }
+
+    protected:
+        // write data to the destination
+        virtual void write_out(const char* data, size_t size) = 0;
+
+        void flush_buffer() {
+            if(buffer_pos != buffer_begin) {
+                write_out(buffer_begin, static_cast<size_t>(buffer_pos - buffer_begin));
+                buffer_pos = buffer_begin;
+            }
+        }
+
+    public:
+        static constexpr size_t default_capacity = 64 * 1024;
+
+        explicit BufferedSink(size_t capacity = default_capacity)
+            : buffer(std::make_unique<char[]>(capacity)), capacity(capacity) {
+            set_buffer(buffer.get(), buffer.get(), buffer.get() + capacity);
+        }
+    };
+
+    // Writes to std::ostream
+    class StreamSink : public BufferedSink
+    {
+        std::ostream& os;
+
+        void write_out(const char* data, size_t size) override {
+            os.write(data, static_cast<std::streamsize>(size));
+        }
+
+    public:
+        explicit StreamSink(std::ostream& os, size_t capacity = default_capacity)
+            : BufferedSink(capacity), os(os) {}
+
+        ~StreamSink() override {
+            flush_buffer();
+        }
+
+        void flush() override {
+            flush_buffer();
+            os.flush();
+        }
+    };
+
+    // Writes to file without stream buffering (large blocks are written directly)
+    class FileSink : public BufferedSink
+    {
+        std::FILE* file{nullptr};
+
+        void write_out(const char* data, size_t size) override {
+            if(std::fwrite(data, 1, size, file) != size) {
+                throw FileError("Couldn't write to output file");
+            }
+        }
+
+    public:
+        static constexpr size_t file_capacity = 256 * 1024;
+
+        explicit FileSink(const std::filesystem::path& path, size_t capacity = file_capacity)
+            : BufferedSink(capacity) {
+            file = std::fopen(path.string().c_str(), "w");
+            if(file) {
+                // our buffer is enough
+                std::setvbuf(file, nullptr, _IONBF, 0);
+            }
+        }
+
+        // errors are ignored here, close() reports them
+        ~FileSink() override {
+            if(file) {
+                try {
+                    flush_buffer();
+                } catch(...) {
+                }
+                std::fclose(file);
+            }
+        }
+
+        // file isn't opened
+        bool fail() const {
+            return !file;
+        }
+
+        void flush() override {
+            flush_buffer();
+        }
+
+        // write buffered data and close the file (e.g. full disk is reported here)
+        void close() {
+            if(!file) {
+                return;
+            }
+            flush_buffer();
+            if(std::fclose(std::exchange(file, nullptr)) != 0) {
+                throw FileError("Couldn't close output file");
+            }
+        }
+    };
+
+    // Discards output, counts written bytes (dry run, size estimation)
+    class CountingSink : public OutputSink
+    {
+        static constexpr size_t scratch_size = 4096;
+
+        char scratch[scratch_size];
+        size_t counted{0};
+
+        void overflow(const char*, size_t size) override {
+            counted += static_cast<size_t>(buffer_pos - buffer_begin) + size;
+            buffer_pos = buffer_begin;
+        }
+
+    public:
+        CountingSink() {
+            set_buffer(scratch, scratch, scratch + scratch_size);
+        }
+
+        size_t count() const {
+            return counted + static_cast<size_t>(buffer_pos - buffer_begin);
+        }
+    };
+
+} // namespace Wizard
@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Wizard {
+
+    // number of threads for jobs option (0 - all cores)
+    inline size_t job_count(size_t jobs) {
+        if(jobs == 0) {
+            jobs = std::thread::hardware_concurrency();
+        }
+        return std::max<size_t>(jobs, 1);
+    }
+
+    // call function(index) for all indexes [0, count) by worker threads (the caller is one of them)
+    // indexes are taken in order, after an error the rest is skipped
+    // the error of the smallest index is rethrown (the same as sequential run)
+    template <typename Function>
+    void parallel_for(size_t count, size_t jobs, Function&& function) {
+        const size_t threads = std::min(job_count(jobs), count);
+        if(threads <= 1) {
+            for(size_t i = 0; i < count; ++i) {
+                function(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::mutex error_mutex;
+        size_t error_index{count};
+        std::exception_ptr error;
+        auto worker = [&] {
+            while(!failed) {
+                const size_t i = next++;
+                if(i >= count) {
+                    break;
+                }
+                try {
+                    function(i);
+                } catch(...) {
+                    std::lock_guard lock(error_mutex);
+                    if(i < error_index) {
+                        error_index = i;
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        };
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(threads - 1);
+            for(size_t t = 1; t < threads; ++t) {
+                workers.emplace_back(worker);
+            }
+            worker();
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+} // namespace Wizard
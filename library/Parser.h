@@ -6,14 +6,17 @@
 #include "Lexer.h"
 #include "FunctionStorage.h"
 #include "Template.h"
+#include "Compiler.h"
+#include "Parallel.h"
 
 namespace Wizard
 {
-    class Parser
+    template <typename LexerType>
+    class BasicParser
     {
     protected:    
-        using Arguments = std::vector<std::shared_ptr<ExpressionNode>>;
-        using OperatorStack = std::stack<std::shared_ptr<FunctionNode>>;
+        using Arguments = std::vector<ExpressionNode*>;
+        using OperatorStack = std::stack<FunctionNode*>;
 
         const ParserConfig &pconfig;
         const LexerConfig &lconfig;
@@ -21,14 +24,19 @@ namespace Wizard
         TemplateStorage &template_storage;
         const FunctionStorage &function_storage;
         //Scanner<Token> sequence;
-        Lexer lexer;
+        LexerType lexer;
+
+        // nested templates found by parser, they are parsed by worker threads after the template
+        std::vector<std::filesystem::path> nested_templates;
+        bool parse_nested_after{true}; // false for parser of nested template (the root parser does it)
 
 
         struct ParserState
         {
             //Scanner<Token>& sequence;
-            Lexer& lexer;
-            Lexer::LexerState lstate;
+            LexerType& lexer;
+            typename LexerType::LexerState lstate;
+            NodeArena& arena; // template nodes
 
             Token tok{}, peek_tok{};
             bool have_peek_tok{false};
@@ -36,7 +44,7 @@ namespace Wizard
             BlockNode* current_block{nullptr};
 
             //ParserState(Scanner<Token>& sequence) : sequence(sequence) {}
-            ParserState(Lexer& lexer, BlockNode* block = nullptr) : lexer(lexer), current_block(block) {}
+            ParserState(LexerType& lexer, NodeArena& arena, BlockNode* block = nullptr) : lexer(lexer), arena(arena), current_block(block) {}
 
             FileStatementNode* current_file_statement{nullptr};
             std::stack<IfStatementNode*> if_statement_stack;
@@ -64,6 +72,13 @@ namespace Wizard
 
         };
 
+        // new node in template arena
+        template <typename T, typename... Args>
+        static T* make_node(ParserState& state, Args&&... args)
+        {
+            return state.arena.template make<T>(std::forward<Args>(args)...);
+        }
+
         inline void throw_parser_error(const std::string &message, ParserState& state) const {
             //throw ParserError(message, get_source_location());
             throw ParserError(message, state.lexer.current_position(state.lstate));
@@ -73,7 +88,7 @@ namespace Wizard
         {
             // string, number or json 
             std::string_view data_text(literal_start.text.data(), state.tok.text.data() - literal_start.text.data() + state.tok.text.size());
-            arguments.emplace_back(std::make_shared<LiteralNode>(data_text, literal_start.offset));
+            arguments.emplace_back(make_node<LiteralNode>(state, data_text, literal_start.offset));
         }
 
         inline void add_operator(ParserState& state, Arguments& arguments, OperatorStack& operator_stack)
@@ -94,9 +109,9 @@ namespace Wizard
             arguments.emplace_back(function);
         }
 
-        std::shared_ptr<FunctionNode> create_function(ParserState& state, Template &tmpl) {
+        FunctionNode* create_function(ParserState& state, Template &tmpl) {
             // create function node
-            auto func = std::make_shared<FunctionNode>(state.tok.text, state.tok.offset);
+            auto func = make_node<FunctionNode>(state, state.tok.text, state.tok.offset);
             // expected Token::Kind::LeftParen (already checked)
             state.get_next_token();
             do
@@ -129,7 +144,7 @@ namespace Wizard
         }
 
         // sub expression (something between Token::Kind::LeftParen and Token::Kind::RightParen)
-        std::shared_ptr<ExpressionNode> create_sub_expression(ParserState& state, Template &tmpl) {
+        ExpressionNode* create_sub_expression(ParserState& state, Template &tmpl) {
             // expected Token::Kind::LeftParen (already checked)
             state.get_next_token();
             auto expr = parse_expression(state, tmpl);
@@ -195,9 +210,9 @@ namespace Wizard
             return  FunctionStorage::Operation::None;
         }
 
-        std::shared_ptr<FunctionNode> create_operator(ParserState& state, Arguments& arguments, OperatorStack& operator_stack) {
+        FunctionNode* create_operator(ParserState& state, Arguments& arguments, OperatorStack& operator_stack) {
             FunctionStorage::Operation operation = get_operator_type(state);
-            auto operator_node = std::make_shared<FunctionNode>(operation, state.tok.offset);
+            auto operator_node = make_node<FunctionNode>(state, operation, state.tok.offset);
 
             // check precedence operators
             // if current operator has low precedence then all operators with higher precedence are copied in argumentsof current function
@@ -236,9 +251,16 @@ namespace Wizard
                 return;
             }
             std::filesystem::path template_path = template_name.string() + ".tpl";
+            if (pconfig.parse_nested_template && pconfig.nested_template_jobs != 1) {
+                // see parse_nested_templates
+                if(std::find(nested_templates.begin(), nested_templates.end(), template_name) == nested_templates.end()) {
+                    nested_templates.push_back(template_name);
+                }
+                return;
+            }
             if (pconfig.parse_nested_template) {
                 // Parse sub template
-                auto sub_parser = Parser(pconfig, lconfig, template_storage, function_storage);
+                auto sub_parser = BasicParser(pconfig, lconfig, template_storage, function_storage);
                 template_storage.emplace(template_name, sub_parser.parse_file(template_path));
                 return;
             }
@@ -249,6 +271,36 @@ namespace Wizard
             }
         }
 
+        // parse found nested templates by waves: templates of a wave are parsed concurrently,
+        // their nested templates make the next wave (storage is changed only between waves)
+        void parse_nested_templates()
+        {
+            while(!nested_templates.empty()) {
+                std::vector<std::filesystem::path> wave;
+                for(auto& name : nested_templates) {
+                    if(template_storage.find(name) == template_storage.end() &&
+                       std::find(wave.begin(), wave.end(), name) == wave.end()) {
+                        wave.push_back(std::move(name));
+                    }
+                }
+                nested_templates.clear();
+
+                std::vector<Template> parsed(wave.size());
+                std::vector<std::vector<std::filesystem::path>> found(wave.size());
+                parallel_for(wave.size(), pconfig.nested_template_jobs, [&](size_t i) {
+                    auto sub_parser = BasicParser(pconfig, lconfig, template_storage, function_storage);
+                    sub_parser.parse_nested_after = false;
+                    parsed[i] = sub_parser.parse_file(wave[i].string() + ".tpl");
+                    found[i] = std::move(sub_parser.nested_templates);
+                });
+                // merge in order of the wave
+                for(size_t i = 0; i < wave.size(); ++i) {
+                    template_storage.emplace(wave[i], std::move(parsed[i]));
+                    nested_templates.insert(nested_templates.end(), found[i].begin(), found[i].end());
+                }
+            }
+        }
+
         bool parse_expression(ParserState& state, Template &tmpl, Token::Kind closing,
                               ExpressionWrapperNode& current_expression)
         {
@@ -256,7 +308,7 @@ namespace Wizard
             return state.tok.kind == closing;
         }
 
-        std::shared_ptr<ExpressionNode> parse_expression(ParserState& state, Template &tmpl)
+        ExpressionNode* parse_expression(ParserState& state, Template &tmpl)
         {
             size_t current_bracket_level{0};
             size_t current_brace_level{0};
@@ -343,7 +395,7 @@ namespace Wizard
                             arguments.emplace_back(func);
                         // Variables
                         } else {
-                            arguments.emplace_back(std::make_shared<DataNode>(state.tok.text, state.tok.offset));
+                            arguments.emplace_back(make_node<DataNode>(state, state.tok.text, state.tok.offset));
                         }
 
                     }
@@ -401,7 +453,7 @@ namespace Wizard
                 add_operator(state, arguments, operator_stack);
             }
             // result must be alone expression (arguments.size() == 1), otherwise is error
-            std::shared_ptr<ExpressionNode> expr;
+            ExpressionNode* expr{nullptr};
             if (arguments.size() == 1) {
                 expr = arguments[0];
             } else if (arguments.size() > 1) {
@@ -415,9 +467,9 @@ namespace Wizard
             // skip current token (keyword "if")
             state.get_next_token();
             // create "if" node
-            auto if_statement_node = std::make_shared<IfStatementNode>(is_nested, state.current_block, state.tok.offset);
+            auto if_statement_node = make_node<IfStatementNode>(state, is_nested, state.current_block, state.tok.offset);
             // if nodes stack 
-            state.if_statement_stack.emplace(if_statement_node.get()); // raw pointers
+            state.if_statement_stack.emplace(if_statement_node);
             // upate current block (true_statement)
             state.current_block->nodes.emplace_back(if_statement_node);
             state.current_block = &if_statement_node->true_statement;
@@ -475,7 +527,7 @@ namespace Wizard
             state.get_next_token();
 
             // for statement
-            std::shared_ptr<ForStatementNode> for_statement_node;
+            ForStatementNode* for_statement_node{nullptr};
 
             // if comma next then the for has two variables (key and value)
             if (state.tok.kind == Token::Kind::Comma) {
@@ -491,13 +543,13 @@ namespace Wizard
                 // skip second variable 
                 state.get_next_token();
                 // Object type
-                for_statement_node = std::make_shared<ForObjectStatementNode>(static_cast<std::string>(key_token.text), 
+                for_statement_node = make_node<ForObjectStatementNode>(state, static_cast<std::string>(key_token.text), 
                                                                               static_cast<std::string>(value_token.text),
                                                                               state.current_block, state.tok.offset);
             } else {
                 // Array type
                 for_statement_node =
-                    std::make_shared<ForArrayStatementNode>(static_cast<std::string>(value_token.text), 
+                    make_node<ForArrayStatementNode>(state, static_cast<std::string>(value_token.text), 
                                                             state.current_block, state.tok.offset);
             }
 
@@ -505,7 +557,7 @@ namespace Wizard
             state.current_block->nodes.emplace_back(for_statement_node);
             state.current_block = &for_statement_node->body;
             // for nodes stack 
-            state.for_statement_stack.emplace(for_statement_node.get()); // raw pointer
+            state.for_statement_stack.emplace(for_statement_node);
 
             // next token should be the "in" keyword
             if (state.tok.kind != Token::Kind::Id || state.tok.text != "in") {
@@ -539,9 +591,9 @@ namespace Wizard
             // skip current token (keyword "file")
             state.get_next_token();
             // create "file" node
-            auto file_statement_node = std::make_shared<FileStatementNode>(state.current_block, state.tok.offset);
+            auto file_statement_node = make_node<FileStatementNode>(state, state.current_block, state.tok.offset);
             // if nodes stack 
-            state.current_file_statement = file_statement_node.get();
+            state.current_file_statement = file_statement_node;
             // upate current block (body)
             state.current_block->nodes.emplace_back(file_statement_node);
             state.current_block = &file_statement_node->body;
@@ -578,7 +630,7 @@ namespace Wizard
 
             // create apply-template 
             auto template_name = normalize_template_name(tmpl.path, static_cast<std::string>(name), state);
-            state.current_block->nodes.emplace_back(std::make_shared<ApplyTemplateStatementNode>(template_name, 
+            state.current_block->nodes.emplace_back(make_node<ApplyTemplateStatementNode>(state, template_name, 
                                                                                                  static_cast<std::string>(field),
                                                                                                  state.tok.offset));
             state.get_next_token();
@@ -596,7 +648,7 @@ namespace Wizard
             }
             std::string key = static_cast<std::string>(state.tok.text);
             // create "set" statement 
-            auto set_statement_node = std::make_shared<SetStatementNode>(key, state.tok.offset);
+            auto set_statement_node = make_node<SetStatementNode>(state, key, state.tok.offset);
             state.current_block->nodes.emplace_back(set_statement_node);
 
             // next token should be "="
@@ -681,7 +733,7 @@ namespace Wizard
             // sequence = scanner(tmpl.content);
             //ParserState state{sequence};
             
-            ParserState state{lexer, &tmpl.root};
+            ParserState state{lexer, *tmpl.arena, &tmpl.root};
             state.lstate = lexer.start(tmpl.content);
 
             for (;;)
@@ -697,11 +749,12 @@ namespace Wizard
                         if (!state.for_statement_stack.empty()) {
                             throw_parser_error("unmatched for", state);
                         }
+                        tmpl.program = Compiler::compile(tmpl);
                     }
                     return;
                 case Token::Kind::Text:
                     {
-                        state.current_block->nodes.emplace_back(std::make_shared<TextNode>(state.tok.offset, state.tok.text.size()));
+                        state.current_block->nodes.emplace_back(make_node<TextNode>(state, state.tok.offset, state.tok.text.size()));
                     }
                     break;
                 case Token::Kind::StatementOpen: // {%
@@ -730,10 +783,10 @@ namespace Wizard
                     {
                         state.get_next_token();
 
-                        auto expression_list_node = std::make_shared<ExpressionWrapperNode>(state.tok.offset);
+                        auto expression_list_node = make_node<ExpressionWrapperNode>(state, state.tok.offset);
                         state.current_block->nodes.emplace_back(expression_list_node);
 
-                        if (!parse_expression(state, tmpl, Token::Kind::ExpressionClose, *expression_list_node.get())) {
+                        if (!parse_expression(state, tmpl, Token::Kind::ExpressionClose, *expression_list_node)) {
                             throw_parser_error("expected expression close, got '" + state.tok.describe() + "'", state);
                         }
                     }
@@ -745,7 +798,7 @@ namespace Wizard
                             throw_parser_error("expected comment close, got '" + state.tok.describe() + "'", state);
                         }
                         if(pconfig.keep_comments) {
-                            auto comment_node = std::make_shared<CommentNode>(state.tok.offset, state.tok.text.size());
+                            auto comment_node = make_node<CommentNode>(state, state.tok.offset, state.tok.text.size());
                             state.current_block->nodes.emplace_back(comment_node);
                         }
                     }
@@ -760,7 +813,7 @@ namespace Wizard
         }
 
     public:
-        explicit Parser(const ParserConfig &parser_config, const LexerConfig &lexer_config, TemplateStorage &template_storage,
+        explicit BasicParser(const ParserConfig &parser_config, const LexerConfig &lexer_config, TemplateStorage &template_storage,
                         const FunctionStorage &function_storage)
             : pconfig(parser_config), lconfig(lexer_config), template_storage(template_storage), function_storage(function_storage), lexer(lexer_config) {}
 
@@ -770,6 +823,9 @@ namespace Wizard
             auto input = load_file(path);
             auto result = Template(input, path);
             parse_into(result);
+            if(parse_nested_after) {
+                parse_nested_templates();
+            }
             return result;
         }
 
@@ -777,6 +833,9 @@ namespace Wizard
         {
             auto result = Template(static_cast<std::string>(input));
             parse_into(result);
+            if(parse_nested_after) {
+                parse_nested_templates();
+            }
             return result;
         }
 
@@ -806,4 +865,9 @@ namespace Wizard
         }
     };
 
+    // parser for custom delimiters
+    using Parser = BasicParser<Lexer>;
+    // parser for the default delimiters
+    using DefaultParser = BasicParser<DefaultLexer>;
+
 } // namespace Wizard
\ No newline at end of file
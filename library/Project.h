@@ -5,6 +5,8 @@
 namespace json = boost::json;
 #include "Environment.h"
 #include "JsonTransformer.h"
+#include "Parallel.h"
+#include "Util.h"
 
 namespace Wizard
 {
@@ -23,13 +25,14 @@ namespace Wizard
             transformer.init(jmodule.at("rules"));
         }
 
+        // the result is used by one render, so it is created in own arena
         json::value transform(const json::value& data) const
         {
             if(transformer.rules().empty()) {
-                return data;
+                return json::value(data, make_json_arena());
             }
             // transform json data
-            return transformer.transform(data);
+            return transformer.transform(data, make_json_arena());
         }
     };
 
@@ -39,14 +42,58 @@ namespace Wizard
         std::filesystem::path info;     // fields template decription file for all templates (optional)
         std::vector<Module> modules;    // templates
 
-        std::string render(Environment& env, const json::value& data, 
-                           const std::filesystem::path& infofile = "")
+        // parsed templates of modules (kept by the cache of environment)
+        std::vector<const Template*> templates(Environment& env, const std::filesystem::path& infofile = "") const
         {
-            std::string result;
+            std::vector<const Template*> result;
+            result.reserve(modules.size());
             for(const auto& module : modules) {
-                auto mdata = module.transform(data);
                 auto ifile = !infofile.empty() ? infofile : (!module.info.empty() ? module.info : info);
-                result += env.render_file(module.name, mdata, ifile);
+                result.push_back(&env.cached_template(module.name, ifile));
+            }
+            return result;
+        }
+
+        // jobs - number of threads rendering modules (1 - sequential, 0 - all cores)
+        // functions (callbacks) have to be thread-safe if it isn't 1
+        std::string render(Environment& env, const json::value& data, 
+                           const std::filesystem::path& infofile = "",
+                           size_t jobs = 1)
+        {
+            // templates are parsed before rendering, renderers share them read-only
+            return render(templates(env, infofile), env.get_render_config(), env.get_templates(), env.get_functions(),
+                          data, jobs);
+        }
+
+        // render parsed templates of modules (environment isn't changed, so it may be shared by renders)
+        std::string render(const std::vector<const Template*>& templates,
+                           const RenderConfig& config,
+                           const TemplateStorage& template_storage,
+                           const FunctionStorage& function_storage,
+                           const json::value& data,
+                           size_t jobs = 1) const
+        {
+            auto render_module = [&](OutputSink& output, size_t i) {
+                Renderer renderer(config, template_storage, function_storage);
+                renderer.render(output, *templates[i], modules[i].transform(data));
+            };
+            std::string result;
+            if(job_count(jobs) == 1 || modules.size() < 2) {
+                // all modules are rendered to one string
+                StringSink output(result);
+                for(size_t i = 0; i < modules.size(); ++i) {
+                    render_module(output, i);
+                }
+            } else {
+                // every module is rendered to own buffer, the result keeps order of modules
+                std::vector<std::string> buffers(modules.size());
+                parallel_for(modules.size(), jobs, [&](size_t i) {
+                    StringSink output(buffers[i]);
+                    render_module(output, i);
+                });
+                for(const auto& buffer : buffers) {
+                    result += buffer;
+                }
             }
             return result;
         }
@@ -54,12 +101,7 @@ namespace Wizard
         void init(const std::filesystem::path& path)
         {
             std::error_code ec;
-            std::ifstream infile;
-            infile.open(path);
-            if(infile.fail()) {
-                throw FileError("Couldn't open file: \"" + path.string() + "\"");
-            }
-            auto project = json::parse(infile, ec);
+            auto project = read_json_file(path, ec, make_json_arena());
             if(ec) {
                 throw FileError(ec.message());
             }
@@ -0,0 +1,345 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <boost/json/parse.hpp>
+#include <boost/json/serialize.hpp>
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "Environment.h"
+#include "Project.h"
+
+namespace Wizard {
+
+    // Render server: keeps parsed templates, descriptions and callbacks of environment between requests
+    // request is one line of json:
+    //   {"template": "<file>", "data": {...}, "info": "<file>", "output": "<dir>"}
+    //   {"project": "<file>", "data": {...}, "info": "<file>", "output": "<dir>", "jobs": <n>}
+    // ("data_file": "<file>" may be used instead of "data")
+    // response is one line of json: {"ok": true, "output": "<text>"} or {"ok": false, "error": "<message>"}
+    // output is returned if the output directory isn't set, otherwise files are written
+    // templates of every directory are kept by own copy of environment (nested templates are stored by
+    // relative names, so directories with the same names of nested templates don't share them)
+    class RenderServer
+    {
+        // templates are parsed under exclusive lock, rendered under shared one
+        struct Directory {
+            Environment env;
+            std::shared_mutex mutex;
+        };
+
+        Environment& env;               // configs and callbacks of directories, projects
+        std::shared_mutex env_mutex;
+        std::mutex directories_mutex;
+        std::map<std::filesystem::path, std::unique_ptr<Directory>> directories;
+
+#ifndef _WIN32
+        std::atomic<bool> stopped{false};
+        std::atomic<int> listen_fd{-1};
+        std::mutex connections_mutex;
+        std::condition_variable connections_done;
+        std::set<int> clients;  // served clients (shut down by stop)
+        size_t max_request_size{64 * 1024 * 1024};
+#endif
+
+        static std::string string_field(const json::object& request, std::string_view name) {
+            const auto value = request.if_contains(name);
+            if(!value) {
+                return {};
+            }
+            if(!value->is_string()) {
+                throw FileError("request field '" + std::string(name) + "' must be a string");
+            }
+            return std::string(value->get_string().c_str());
+        }
+
+        static json::value read_data(const json::object& request) {
+            if(const auto data = request.if_contains("data")) {
+                return *data;
+            }
+            const auto file = string_field(request, "data_file");
+            if(file.empty()) {
+                return json::value(json::object_kind);
+            }
+            return read_json_file(file, make_json_arena());
+        }
+
+        std::string render_template(const json::object& request) {
+            const std::filesystem::path file = string_field(request, "template");
+            const std::filesystem::path info = string_field(request, "info");
+            const std::filesystem::path output = string_field(request, "output");
+            const auto data = read_data(request);
+
+            auto& directory = get_directory(file.parent_path());
+            RenderConfig config;
+            Template tmpl;
+            {
+                std::unique_lock lock(directory.mutex);
+                // template is copied (nodes are shared), cache may be changed by next requests
+                tmpl = directory.env.cached_template(file.filename(), info);
+                config = directory.env.get_render_config();
+            }
+            config.dry_run = output.empty();
+            config.output_dir = output;
+
+            std::shared_lock lock(directory.mutex);
+            std::string result;
+            {
+                StringSink sink(result);
+                Renderer renderer(config, directory.env.get_templates(), directory.env.get_functions());
+                renderer.render(sink, tmpl, data);
+            }
+            return result;
+        }
+
+        // environment of templates directory (copy of server environment)
+        Directory& get_directory(const std::filesystem::path& path) {
+            std::error_code ec;
+            auto key = std::filesystem::absolute(path, ec);
+            key = (ec ? path : key).lexically_normal();
+            std::lock_guard lock(directories_mutex);
+            auto& directory = directories[key];
+            if(!directory) {
+                std::shared_lock env_lock(env_mutex);
+                directory.reset(new Directory{env, {}});
+                directory->env.clear_template_cache();
+                directory->env.set_template_directory(path);
+            }
+            return *directory;
+        }
+
+        std::string render_project(const json::object& request) {
+            const std::filesystem::path file = string_field(request, "project");
+            const std::filesystem::path info = string_field(request, "info");
+            const std::filesystem::path output = string_field(request, "output");
+            size_t jobs = 1;
+            if(const auto value = request.if_contains("jobs"); value && value->is_int64() && value->get_int64() >= 0) {
+                jobs = static_cast<size_t>(value->get_int64());
+            }
+            const auto data = read_data(request);
+            Project project;
+            project.init(file);
+
+            // modules are templates of the server templates directory
+            std::filesystem::path templates_dir;
+            {
+                std::shared_lock env_lock(env_mutex);
+                templates_dir = env.get_template_directory();
+            }
+            auto& directory = get_directory(templates_dir);
+            RenderConfig config;
+            std::vector<Template> templates;
+            {
+                std::unique_lock lock(directory.mutex);
+                // templates are copied (nodes are shared), cache may be changed by next requests
+                for(const auto tmpl : project.templates(directory.env, info)) {
+                    templates.push_back(*tmpl);
+                }
+                config = directory.env.get_render_config();
+            }
+            config.dry_run = output.empty();
+            config.output_dir = output;
+
+            std::vector<const Template*> modules;
+            for(const auto& tmpl : templates) {
+                modules.push_back(&tmpl);
+            }
+            std::shared_lock lock(directory.mutex);
+            return project.render(modules, config, directory.env.get_templates(), directory.env.get_functions(),
+                                  data, jobs);
+        }
+
+#ifndef _WIN32
+        // false if client is gone (no SIGPIPE for closed connection)
+        static bool write_all(int fd, std::string_view text) {
+#ifdef MSG_NOSIGNAL
+            constexpr int flags = MSG_NOSIGNAL;
+#else
+            constexpr int flags = 0;    // SO_NOSIGPIPE is set for the client socket
+#endif
+            while(!text.empty()) {
+                const auto written = ::send(fd, text.data(), text.size(), flags);
+                if(written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if(written <= 0) {
+                    return false;
+                }
+                text.remove_prefix(static_cast<size_t>(written));
+            }
+            return true;
+        }
+
+        // requests of one client (line by line), the client is closed by caller
+        void serve_connection(int fd) {
+            std::string buffer;
+            char chunk[64 * 1024];
+            for(;;) {
+                const auto size = ::read(fd, chunk, sizeof(chunk));
+                if(size < 0 && errno == EINTR) {
+                    continue;
+                }
+                if(size <= 0) {
+                    break;
+                }
+                buffer.append(chunk, static_cast<size_t>(size));
+                size_t start = 0;
+                for(auto end = buffer.find('\n'); end != std::string::npos; end = buffer.find('\n', start)) {
+                    const auto line = std::string_view(buffer).substr(start, end - start);
+                    start = end + 1;
+                    if(line.find_first_not_of(" \t\r") == std::string_view::npos) {
+                        continue;
+                    }
+                    if(!write_all(fd, handle(line) + '\n')) {
+                        return;
+                    }
+                }
+                buffer.erase(0, start);
+                // line without end can't grow without bound
+                if(buffer.size() > max_request_size) {
+                    json::object response;
+                    response["ok"] = false;
+                    response["error"] = "request is too long";
+                    write_all(fd, json::serialize(response) + '\n');
+                    return;
+                }
+            }
+        }
+#endif
+
+    public:
+        explicit RenderServer(Environment& env) : env(env) {}
+
+        RenderServer(const RenderServer&) = delete;
+        RenderServer& operator=(const RenderServer&) = delete;
+
+        ~RenderServer() {
+#ifndef _WIN32
+            stop();
+#endif
+        }
+
+        // environment of templates directory (parsed templates of the directory)
+        Environment& directory_environment(const std::filesystem::path& dir) {
+            return get_directory(dir).env;
+        }
+
+        // process one request, errors are returned in response
+        std::string handle(std::string_view line) {
+            json::object response;
+            try {
+                std::error_code ec;
+                auto request = json::parse(line, ec);
+                if(ec || !request.is_object()) {
+                    throw FileError("request must be json object");
+                }
+                const auto& object = request.as_object();
+                if(object.contains("template")) {
+                    response["output"] = render_template(object);
+                } else if(object.contains("project")) {
+                    response["output"] = render_project(object);
+                } else {
+                    throw FileError("request must contain 'template' or 'project'");
+                }
+                response["ok"] = true;
+            } catch(const std::exception& err) {
+                response["ok"] = false;
+                response["error"] = err.what();
+            }
+            return json::serialize(response);
+        }
+
+#ifndef _WIN32
+        // accept clients until stop (every client is served by own thread)
+        void run(const std::filesystem::path& socket_path) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            const auto path = socket_path.string();
+            if(path.size() >= sizeof(address.sun_path)) {
+                throw FileError("socket path is too long: \"" + path + "\"");
+            }
+            path.copy(address.sun_path, path.size());
+
+            listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if(listen_fd < 0) {
+                throw FileError("Couldn't create socket");
+            }
+            ::unlink(path.c_str());
+            if(::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+               ::listen(listen_fd, SOMAXCONN) != 0) {
+                ::close(listen_fd);
+                listen_fd = -1;
+                throw FileError("Couldn't listen socket: \"" + path + "\"");
+            }
+            while(!stopped) {
+                const int client = ::accept(listen_fd, nullptr, nullptr);
+                if(client < 0) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+                const int on = 1;
+                ::setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+                {
+                    std::lock_guard lock(connections_mutex);
+                    clients.insert(client);
+                    if(stopped) {
+                        ::shutdown(client, SHUT_RDWR);
+                    }
+                }
+                std::thread([this, client] {
+                    serve_connection(client);
+                    std::lock_guard lock(connections_mutex);
+                    clients.erase(client);
+                    ::close(client);
+                    if(clients.empty()) {
+                        connections_done.notify_all();
+                    }
+                }).detach();
+            }
+            ::close(listen_fd);
+            ::unlink(path.c_str());
+            // wait for connected clients
+            std::unique_lock lock(connections_mutex);
+            connections_done.wait(lock, [this] { return clients.empty(); });
+        }
+
+        // stop accepting of clients and disconnect them (run returns after running requests)
+        void stop() {
+            if(stopped.exchange(true)) {
+                return;
+            }
+            if(listen_fd >= 0) {
+                ::shutdown(listen_fd, SHUT_RDWR);
+            }
+            std::lock_guard lock(connections_mutex);
+            for(const int client : clients) {
+                ::shutdown(client, SHUT_RDWR);
+            }
+        }
+
+        // longest request line (longer one is answered by error, the client is disconnected)
+        void set_max_request_size(size_t size) {
+            max_request_size = size;
+        }
+#endif
+    };
+
+} // namespace Wizard
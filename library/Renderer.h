@@ -1,5 +1,9 @@
 #pragma once
 #include <stack>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <optional>
 #include <filesystem>
 #include <numeric>
 #include <vector>
@@ -7,48 +11,224 @@
 #include <sstream>
 #include <array>
 #include <ranges>
+#include <charconv>
 #include <boost/json/parse.hpp>
 #include <boost/json/string.hpp>
 #include <boost/json/error.hpp>
+#include <boost/json/serializer.hpp>
 namespace json = boost::json;
 
 #include "Desc.h"
 #include "Config.h"
 #include "Node.h"
 #include "Template.h"
+#include "Bytecode.h"
+#include "Compiler.h"
+#include "Output.h"
+#include "Parallel.h"
 
 namespace Wizard
 {
-    class Renderer : public NodeVisitor
+    // Temporary values of expression evaluation
+    // addresses are stable until reset, memory of slots is reused by next expressions
+    // values are created by own monotonic resource released by reset (values of other memory resources are copied into it)
+    class TemporaryValues
+    {
+        static constexpr size_t chunk_size = 32;
+        static constexpr size_t buffer_size = 4096;
+
+        // uninitialized slots (values are constructed by make and destroyed by reset)
+        struct Chunk {
+            alignas(json::value) std::byte data[chunk_size * sizeof(json::value)];
+        };
+
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        size_t count{0};
+        // small expressions fit into the initial buffer, blocks of larger ones are freed by reset
+        alignas(std::max_align_t) unsigned char buffer[buffer_size];
+        json::monotonic_resource resource{buffer, buffer_size};
+        json::storage_ptr storage{&resource};
+
+        json::value* slot(size_t index) const {
+            return reinterpret_cast<json::value*>(chunks[index / chunk_size]->data) + index % chunk_size;
+        }
+
+        template <typename Value>
+        json::value* emplace(Value&& value) {
+            if(count == chunks.size() * chunk_size) {
+                chunks.push_back(std::make_unique<Chunk>());
+            }
+            auto result = std::construct_at(slot(count), std::forward<Value>(value), storage);
+            count += 1;
+            return result;
+        }
+
+    public:
+        TemporaryValues() = default;
+        TemporaryValues(const TemporaryValues&) = delete;
+        TemporaryValues& operator=(const TemporaryValues&) = delete;
+
+        ~TemporaryValues() {
+            reset();
+        }
+
+        const json::storage_ptr& get_storage() const {
+            return storage;
+        }
+
+        json::value* make(json::value&& value) {
+            return emplace(std::move(value));
+        }
+
+        json::value* make(const json::value& value) {
+            return emplace(value);
+        }
+
+        bool owns(const json::value* value) const {
+            const std::less<const json::value*> less;
+            for(size_t i = 0; i < chunks.size(); ++i) {
+                const auto first = slot(i * chunk_size);
+                if(!less(value, first) && less(value, first + chunk_size)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool empty() const {
+            return count == 0;
+        }
+
+        // move value out, it has to live longer than expression
+        // (its memory is still released by reset, values kept longer are copied into other storage)
+        json::value take(const json::value* value) {
+            return std::move(*const_cast<json::value*>(value));
+        }
+
+        // release values of evaluated expression
+        void reset() {
+            for(size_t i = 0; i < count; ++i) {
+                std::destroy_at(slot(i));
+            }
+            count = 0;
+            resource.release();
+        }
+    };
+
+    // Result of top-level expression: borrowed from data or owned (created by expression)
+    class EvalResult
+    {
+        const json::value* borrowed{nullptr};
+        json::value owned{};
+
+    public:
+        EvalResult() = default;
+        explicit EvalResult(const json::value* value) : borrowed(value) {}
+        explicit EvalResult(json::value&& value) : owned(std::move(value)) {}
+
+        const json::value& operator*() const { return borrowed ? *borrowed : owned; }
+        const json::value* operator->() const { return &**this; }
+        const json::value* get() const { return &**this; }
+
+        bool is_owned() const { return !borrowed; }
+
+        // keep own copy of borrowed value
+        void own() {
+            if(borrowed) {
+                owned = *borrowed;
+                borrowed = nullptr;
+            }
+        }
+
+        // value to store: owned value is moved, borrowed one is copied
+        json::value release() && {
+            return borrowed ? json::value(*borrowed) : std::move(owned);
+        }
+    };
+
+    // Stack machine executing compiled template (see Compiler)
+    class Renderer
     {
         using Op = FunctionStorage::Operation;
 
+        // state of running for loop (variables are in slots, see Program::slots)
+        struct LoopFrame {
+            EvalResult container{};                 // iterated array or object
+            const Instruction* instruction{nullptr}; // ForArray or ForObject, arg is the first slot
+            size_t index{0};
+            size_t size{0};
+        };
+
+        // variable of slot
+        struct SlotValue {
+            const json::value* ref{nullptr};        // current value (nullptr if variable isn't set)
+            json::value value{};                    // own value (set statement, key, loop metadata)
+        };
+
+        // state of file statement
+        struct FileFrame {
+            OutputSink* output;                     // previous output
+            std::unique_ptr<FileSink> file{};
+            std::string filename{};                 // dry run
+        };
+
         const RenderConfig& config;
         const TemplateStorage& template_storage;
         const FunctionStorage& function_storage;
 
         const Template* current_template { nullptr };
+        const Program* current_program { nullptr };
         size_t current_level{0};
+        size_t apply_template_jobs{1};  // worker threads of apply-template (nested statements are sequential)
+        bool render_arena{true};        // every render allocates variables from own monotonic arena
+        json::storage_ptr render_storage; // memory resource of variables (values of statements are temporaries)
 
-        std::ostream* output_stream;    // output stream
+        OutputSink* output{nullptr};    // output of rendered text
+        json::serializer serializer;      // printing of arrays and objects (reused)
         const json::value* input_data {nullptr};  // user data
 
         json::value additional_data{json::object_kind};   // additional data
 
         std::vector<const Template*> template_stack;
-        std::vector<std::shared_ptr<json::value>> data_tmp_stack; // created variables 
-        std::stack<const json::value*> data_eval_stack; // pointers to variables (created or input data reference)
-        std::stack<const DataNode*> not_found_stack; // undeclared variables
-        std::stack<std::ostream*> file_stack; 
+        std::vector<std::shared_ptr<const Program>> compiled_programs; // programs of not compiled templates
+        TemporaryValues temporaries; // created variables (released after each top-level expression)
+        std::stack<const json::value*, std::vector<const json::value*>> data_eval_stack; // pointers to variables (created or input data reference)
+        std::stack<const Instruction*, std::vector<const Instruction*>> not_found_stack; // undeclared variables (Data instructions)
+        Arguments call_arguments; // arguments of function call (reused)
+        std::deque<LoopFrame> loop_stack;
+        std::vector<SlotValue> slots;     // loop and set variables
+        std::vector<const Variable*> described_variables; // description by name index (empty if template has no description)
+        static inline const Variable unresolved_variable{};
+        std::stack<FileFrame> file_stack; 
+        // find_path results (buffers are reused between lookups)
+        const json::value* found_value{nullptr};
+        std::vector<const json::value*> found_values;
+        std::vector<const json::value*> next_values;
 
     public:
 
         Renderer(const RenderConfig& config, const TemplateStorage& template_storage, const FunctionStorage& function_storage)
-            : config(config), template_storage(template_storage), function_storage(function_storage){}
+            : config(config), template_storage(template_storage), function_storage(function_storage),
+              apply_template_jobs(config.apply_template_jobs) {}
 
         void render(std::ostream& os, const Template& tmpl, const json::value& data, json::value* loop_data = nullptr) {
-            output_stream = &os;
+            StreamSink sink(os);
+            render(sink, tmpl, data, loop_data);
+        }
+
+        // memory resource of variables created by render (set statements, loop metadata)
+        // by default every render has own monotonic arena released at once at the end of render
+        // values created by expressions are temporaries released after each statement
+        void set_storage(json::storage_ptr storage) {
+            render_arena = false;
+            render_storage = std::move(storage);
+        }
+
+        void render(OutputSink& out, const Template& tmpl, const json::value& data, json::value* loop_data = nullptr) {
+            begin_render();
+            output = &out;
             current_template = &tmpl;
+            current_program = &get_program(tmpl);
             input_data = &data;
             if(loop_data) {
                 additional_data = *loop_data;
@@ -57,25 +237,41 @@ namespace Wizard
             }
 
             template_stack.emplace_back(current_template);
-            current_template->root.accept(*this);
+            assign_slots();
+            describe_variables();
+            execute(0, current_program->code.size());
 
-            data_tmp_stack.clear();
+            end_storage();
         }
 
+        // the result is allocated by default memory resource (it isn't bound to the arena of render)
         json::value evaluate_expression(const Template& tpl, const json::value& data)
         {
-            if(tpl.root.nodes.empty()){
-                throw_renderer_error("empty expression", tpl.root);
-            }
+            begin_render();
             input_data = &data;
             current_template = &tpl;
-            auto node = tpl.root.nodes.begin()->get();
-            const ExpressionWrapperNode* pExpression = dynamic_cast<const ExpressionWrapperNode*>(node);
-            if(!pExpression) {
-                throw_renderer_error("Template doesn't contain a expression node", *node);
+            if(tpl.root.nodes.empty()){
+                throw_renderer_error("empty expression", tpl.root.pos);
+            }
+            auto node = tpl.root.nodes.front();
+            if(!dynamic_cast<const ExpressionWrapperNode*>(node)) {
+                throw_renderer_error("Template doesn't contain a expression node", node->pos);
+            }
+            current_program = &get_program(tpl);
+            assign_slots();
+            describe_variables();
+            // the expression code ends with the first print
+            const auto& code = current_program->code;
+            const auto print = std::find_if(code.begin(), code.end(), [](const Instruction& ins) {
+                return ins.code == OpCode::Print;
+            });
+            if(print == code.end()) {
+                throw_renderer_error("empty expression", node->pos);
             }
-            auto result = eval_expression(*pExpression);
-            return *result.get();
+            execute(0, static_cast<size_t>(std::distance(code.begin(), print)));
+            json::value value(*eval_result(print->pos), json::storage_ptr());
+            end_storage();
+            return value;
         }
 
         static bool truthy(const json::value* data) {
@@ -101,53 +297,117 @@ namespace Wizard
 
     protected:
 
-        void throw_renderer_error(const std::string& message, const AstNode& node) {
-            SourceLocation loc = get_source_location(current_template->content, node.pos);
+        void throw_renderer_error(const std::string& message, size_t pos) {
+            SourceLocation loc = get_source_location(current_template->content, pos);
             throw RenderError(message, loc);
         }
 
-        void make_result(const json::value && result) {
-            auto result_ptr = std::make_shared<json::value>(result);
-            data_tmp_stack.push_back(result_ptr);
-            data_eval_stack.push(result_ptr.get());
+        const Program& get_program(const Template& tmpl) {
+            if(tmpl.program && tmpl.program->loop_variable_name == config.loop_variable_name) {
+                return *tmpl.program;
+            }
+            // template is created without parser or with other name of loop variable
+            compiled_programs.push_back(Compiler::compile(tmpl, config.loop_variable_name));
+            return *compiled_programs.back();
+        }
+
+        const std::string& get_name(uint32_t index) const {
+            return current_program->names[index];
+        }
+
+        // memory resource of values created by expressions (released after each statement)
+        const json::storage_ptr& storage() const {
+            return temporaries.get_storage();
+        }
+
+        // state of failed render (thrown inside loop, file or expression) is dropped
+        void begin_render() {
+            loop_stack.clear();
+            data_eval_stack = {};
+            not_found_stack = {};
+            file_stack = {};
+            template_stack.clear();
+            temporaries.reset();
+            begin_storage();
+        }
+
+        void begin_storage() {
+            if(render_arena) {
+                render_storage = make_json_arena();
+            }
+        }
+
+        // the arena is freed with the last value using it
+        void end_storage() {
+            temporaries.reset();
+            slots.clear();
+            if(render_arena) {
+                render_storage = {};
+            }
+        }
+
+        // variables are created by storage of render
+        void assign_slots() {
+            slots.assign(current_program->slots.size(), SlotValue{nullptr, json::value(render_storage)});
+        }
+
+
+        void make_result(json::value && result) {
+            data_eval_stack.push(temporaries.make(std::move(result)));
         }
 
         void make_result(const json::value & result) {
-            auto result_ptr = std::make_shared<json::value>(result);
-            data_tmp_stack.push_back(result_ptr);
-            data_eval_stack.push(result_ptr.get());
+            data_eval_stack.push(temporaries.make(result));
         }
 
         auto create_empty_variable() {
-            auto result_ptr = std::make_shared<json::value>(nullptr);
-            data_tmp_stack.push_back(result_ptr); // anchor created variable
-            return result_ptr.get();
+            return temporaries.make(nullptr);
         }
 
         auto create_array_variable(const std::vector<const json::value*>& data) {
-            auto result_ptr = std::make_shared<json::value>(json::array_kind);
+            json::value result(json::array_kind, storage());
+            auto& array = result.as_array();
+            array.reserve(data.size());
             for(const auto& pvalue : data){
-                result_ptr->as_array().push_back(*pvalue);
+                array.push_back(*pvalue);
+            }
+            return temporaries.make(std::move(result));
+        }
+
+        // description of variable by name index, resolved once per render (nullptr if it isn't described)
+        const Variable* find_description(uint32_t name) {
+            if(described_variables.empty()) {
+                return nullptr;
+            }
+            auto& var = described_variables[name];
+            if(var == &unresolved_variable) {
+                var = current_template->desc.find_variable(get_name(name));
             }
-            data_tmp_stack.push_back(result_ptr); // anchor created variable
-            return result_ptr.get();
+            return var;
         }
 
-        void add_checked_data(const DataNode& node, const json::value* data){
-            const auto& datapath = node.name;
-            const Description& tpldesc = current_template->desc;
-            Variable var;
-            if(!tpldesc.find_variable(datapath, var)) {
+        void describe_variables() {
+            if(current_template->desc.variables.empty()) {
+                described_variables.clear();
+            } else {
+                described_variables.assign(current_program->names.size(), &unresolved_variable);
+            }
+        }
+
+        void add_checked_data(const Instruction& ins, const json::value* data){
+            const auto pvar = find_description(ins.arg);
+            if(!pvar) {
                 // no description, nothing to do
                 if(data) {
                     data_eval_stack.push(data);
                 } else {
                     // not found
                     data_eval_stack.push(nullptr);
-                    not_found_stack.emplace(&node);
+                    not_found_stack.emplace(&ins);
                 }
                 return; 
             }
+            const auto& var = *pvar;
             // set default value
             if(!data && !var.defvalue.is_null()) {
                 make_result(var.defvalue);
@@ -155,8 +415,8 @@ namespace Wizard
             }
             // check required
             if(!data && var.required) {
-                std::string message = "The \"" + datapath + "\" variable should be set"; 
-                throw_renderer_error(message, node);
+                std::string message = "The \"" + get_name(ins.arg) + "\" variable should be set"; 
+                throw_renderer_error(message, ins.pos);
 
             }
             // optional value
@@ -164,7 +424,7 @@ namespace Wizard
                 create_empty_variable();
                 // not found data
                 // data_eval_stack.push(nullptr);
-                // not_found_stack.emplace(&node);
+                // not_found_stack.emplace(&ins);
                 return;
             }
             // no type, nothing to do
@@ -173,110 +433,62 @@ namespace Wizard
                 return;
             }
             // check type and conversion
-            make_result(convert_value(var.type, *data));
+            make_result(convert_value(var.type, *data, storage()));
         }
 
-        template <size_t N, size_t N_start = 0, bool throw_not_found = true>
-        std::array<const json::value*, N> get_arguments(const FunctionNode &node) {
-            if (node.arguments.size() < N_start + N) {
-                throw_renderer_error("function needs " + std::to_string(N_start + N) + " variables, but has only found " + std::to_string(node.arguments.size()), node);
-            }
-
-            for(size_t i = N_start; i < N_start + N; i += 1) {
-                node.arguments[i]->accept(*this);
-            }
-
-            if(data_eval_stack.size() < N) {
-                throw_renderer_error("function needs " + std::to_string(N) + " variables, but has only found " + std::to_string(data_eval_stack.size()), node);
-            }
-
-            std::array<const json::value*, N> result;
-            for(size_t i = 0; i < N; i += 1) {
-                result[N - i - 1] = data_eval_stack.top();
-                data_eval_stack.pop();
-
-                if(!result[N - i - 1]) {
-                    const auto data_node = not_found_stack.top();
-                    not_found_stack.pop();
-                    if (throw_not_found) {
-                        if(config.strict) {
-                            throw_renderer_error("variable '" + data_node->name + "' not found", *data_node);
-                        } else {
-                            result[N - i - 1] = create_empty_variable();
-                        }
+        // pop function argument from evaluation stack
+        template <bool throw_not_found = true>
+        const json::value* pop_argument() {
+            auto result = data_eval_stack.top();
+            data_eval_stack.pop();
+            if(!result) {
+                const auto data_ins = not_found_stack.top();
+                not_found_stack.pop();
+                if (throw_not_found) {
+                    if(config.strict) {
+                        throw_renderer_error("variable '" + get_name(data_ins->arg) + "' not found", data_ins->pos);
+                    } else {
+                        result = create_empty_variable();
                     }
                 }
             }
             return result;
         }
 
-        template <bool throw_not_found = true>
-        Arguments get_argument_vector(const FunctionNode &node) {
-            const size_t N = node.arguments.size();
-            for (auto a : node.arguments) {
-                a->accept(*this);
-            }
-
-            if(data_eval_stack.size() < N) {
-                throw_renderer_error("function needs " + std::to_string(N) + " variables, but has only found " + std::to_string(data_eval_stack.size()), node);
-            }
-
-            Arguments result{N};
-            for(size_t i = 0; i < N; i += 1) {
-                result[N - i - 1] = data_eval_stack.top();
-                data_eval_stack.pop();
-
-                if(!result[N - i - 1]) {
-                    const auto data_node = not_found_stack.top();
-                    not_found_stack.pop();
-                    if (throw_not_found){
-                        if(config.strict) {
-                            throw_renderer_error("variable '" + data_node->name + "' not found", *data_node);
-                        } else {
-                            result[N - i - 1] = create_empty_variable();
-                        }
-                    }
-                }
-            }
-            return result;
+        template <typename Number, typename... Format>
+        static void print_number(OutputSink& out, Number number, Format... format) {
+            char buffer[32];
+            const auto result = std::to_chars(buffer, buffer + sizeof(buffer), number, format...);
+            out.write(buffer, static_cast<size_t>(result.ptr - buffer));
         }
 
-        static void print_expression(std::ostream& os, const json::value& value) {
+        void print_expression(OutputSink& out, const json::value& value) {
             if (value.is_bool()){
-                os << value.as_bool();
+                out.put(value.as_bool() ? '1' : '0');
             } else if (value.is_uint64()) {
-                os << value.as_uint64();
+                print_number(out, value.as_uint64());
             } else if (value.is_int64()) {
-                os << value.as_int64();
+                print_number(out, value.as_int64());
             } else if (value.is_double()) {
-                os << value.as_double();
+                // the same as default stream output (%g)
+                print_number(out, value.as_double(), std::chars_format::general, 6);
             } else if (value.is_string()) {
-                os << value.as_string().c_str(); // otherwise the value is surrounded with ""
-            } else if (value.is_array()) {
-                os << value;
-                // os << "[";
-                // for(const auto& svalue : value.as_array()) {
-                //     print_expression(os, svalue);
-                //     os << ", ";
-                // }
-                // os << "]";
-            } else if (value.is_object()) {
-                // os << "{";
-                // for(const auto& [sname, svalue] : value.as_object()) {
-                //     os  << std::quoted(static_cast<std::string>(sname)) << ": ";
-                //     print_expression(os, svalue);
-                //     os << ", ";
-                // }
-                // os << "}";
-                os << value;
+                const auto& str = value.as_string(); // otherwise the value is surrounded with ""
+                out.write(str.data(), str.size());
+            } else if (value.is_array() || value.is_object()) {
+                serializer.reset(&value);
+                char buffer[4096];
+                while(!serializer.done()) {
+                    out.write(serializer.read(buffer));
+                }
             } else if (value.is_null()) {
             }
         }
 
-        auto make_json_comparer(const AstNode& node) {
-            return [&](const auto& lhs, const auto& rhs){
+        auto make_json_comparer(size_t pos) {
+            return [this, pos](const auto& lhs, const auto& rhs){
                 if(lhs.kind() != rhs.kind() || (!lhs.is_number() && !lhs.is_string())) {
-                    throw_renderer_error("the compare operator works only with array of numbers or strings", node);
+                    throw_renderer_error("the compare operator works only with array of numbers or strings", pos);
                 } else if(lhs.is_string()) {
                     return lhs.as_string() < rhs.as_string();
                 } else if(lhs.is_double()) {
@@ -286,22 +498,17 @@ namespace Wizard
                 } else {
                     return lhs.as_uint64() < rhs.as_uint64();
                 }
-                throw_renderer_error("Unknown json type", node);
+                throw_renderer_error("Unknown json type", pos);
                 return false;
             };   
         }
 
-        const std::shared_ptr<json::value> eval_expression(const ExpressionWrapperNode& expression){
-            if(!expression.root){
-                throw_renderer_error("empty expression", expression);
-            }
-
-            expression.root->accept(*this);
-
+        // pop result of top-level expression: created value is moved out of temporaries, data is borrowed
+        EvalResult eval_result(size_t pos) {
             if(data_eval_stack.empty()) {
-                throw_renderer_error("empty expression", expression);
+                throw_renderer_error("empty expression", pos);
             } else if(data_eval_stack.size() != 1) {
-                throw_renderer_error("malformed expression", expression);
+                throw_renderer_error("malformed expression", pos);
             }
 
             const auto result = data_eval_stack.top();
@@ -309,111 +516,278 @@ namespace Wizard
 
             if(!result) {
                 if(not_found_stack.empty()) {
-                    throw_renderer_error("expression could not be evaluated", expression);
+                    throw_renderer_error("expression could not be evaluated", pos);
                 }
-                auto node = not_found_stack.top();
+                auto data_ins = not_found_stack.top();
                 not_found_stack.pop();
                 if(config.strict) {
-                    throw_renderer_error("variable '" + node->name + "' not found", *node);
+                    throw_renderer_error("variable '" + get_name(data_ins->arg) + "' not found", data_ins->pos);
                 } else {
-                    return std::make_shared<json::value>(nullptr);
+                    return EvalResult(json::value(nullptr));
                 }
             }
-            return std::make_shared<json::value>(*result);
+            if(temporaries.owns(result)) {
+                return EvalResult(temporaries.take(result));
+            }
+            if(!temporaries.empty()) {
+                // result may be a part of created value (e.g. member of function result)
+                return EvalResult(json::value(*result));
+            }
+            return EvalResult(result);
         }
 
-        void visit(const BlockNode &node){
-            for (auto& child : node.nodes){
-                child->accept(*this);
+        // interpreter loop: run instructions [begin, end)
+        void execute(size_t begin, size_t end) {
+            const auto& program = *current_program;
+            const Instruction* code = program.code.data();
+            size_t pc = begin;
+            while(pc < end) {
+                const Instruction& ins = code[pc++];
+                switch(ins.code) {
+                case OpCode::Text:
+                    output->write(current_template->content.data() + ins.pos, ins.arg);
+                    break;
+                case OpCode::Print:
+                    print_expression(*output, *eval_result(ins.pos));
+                    temporaries.reset();
+                    break;
+                case OpCode::Constant:
+                    data_eval_stack.push(&program.constants[ins.arg]);
+                    break;
+                case OpCode::Data:
+                    push_data(ins, ins.extra);
+                    break;
+                case OpCode::Local:
+                    push_local(ins);
+                    break;
+                case OpCode::Member:
+                    {
+                        const auto container = pop_argument<false>();
+                        if(!container) {
+                            throw_renderer_error("could not find element with given name", ins.pos);
+                        }
+                        data_eval_stack.push(&container->at(get_name(ins.arg)));
+                    }
+                    break;
+                case OpCode::Call:
+                    {
+                        const size_t N = ins.arg;
+                        if(data_eval_stack.size() < N) {
+                            throw_renderer_error("function needs " + std::to_string(N) + " variables, but has only found " + std::to_string(data_eval_stack.size()), ins.pos);
+                        }
+                        auto& args = call_arguments;
+                        args.resize(N);
+                        for(size_t i = 0; i < N; i += 1) {
+                            args[N - i - 1] = pop_argument();
+                        }
+                        call_function(ins, args);
+                    }
+                    break;
+                case OpCode::And:
+                    if(!truthy(pop_argument())) {
+                        make_result(false);
+                        pc = ins.target;
+                    }
+                    break;
+                case OpCode::Or:
+                    if(truthy(pop_argument())) {
+                        make_result(true);
+                        pc = ins.target;
+                    }
+                    break;
+                case OpCode::Default:
+                    {
+                        const auto test_arg = pop_argument<false>();
+                        if(test_arg) {
+                            data_eval_stack.push(test_arg);
+                            pc = ins.target;
+                        }
+                    }
+                    break;
+                case OpCode::Bool:
+                    make_result(truthy(pop_argument()));
+                    break;
+                case OpCode::Require:
+                    data_eval_stack.push(pop_argument());
+                    break;
+                case OpCode::Jump:
+                    pc = ins.target;
+                    break;
+                case OpCode::JumpIfFalse:
+                    {
+                        const bool condition = truthy(eval_result(ins.pos).get());
+                        temporaries.reset();
+                        if(!condition) {
+                            pc = ins.target;
+                        }
+                    }
+                    break;
+                case OpCode::ForArray:
+                case OpCode::ForObject:
+                    {
+                        const bool has_items = begin_loop(ins);
+                        temporaries.reset();
+                        if(!has_items) {
+                            pc = ins.target;
+                        }
+                    }
+                    break;
+                case OpCode::Next:
+                    if(next_loop()) {
+                        pc = ins.target;
+                    }
+                    break;
+                case OpCode::FileBegin:
+                    begin_file(ins);
+                    temporaries.reset();
+                    break;
+                case OpCode::FileEnd:
+                    end_file(ins);
+                    break;
+                case OpCode::ApplyTemplate:
+                    apply_template(ins);
+                    break;
+                case OpCode::Set:
+                    {
+                        auto value = eval_result(ins.pos);
+                        detach_loops(ins.arg);
+                        set_variable(ins, std::move(value).release());
+                        temporaries.reset();
+                    }
+                    break;
+                case OpCode::Error:
+                    throw_renderer_error(get_name(ins.arg), ins.pos);
+                    break;
+                }
             }
         }
 
-        void visit(const ExpressionWrapperNode& node) {
-            auto expr = eval_expression(node);
-            print_expression(*output_stream, *expr);
+        // find values by pre-split path (the same result as boost::json::find_pointers)
+        // returns number of values: single value is in found_value, several values are in found_values
+        size_t find_path(const json::value& root, const DataPath& path, size_t start = 0) {
+            const json::value* value = &root;
+            for(size_t i = start; i < path.size(); ++i) {
+                const auto& segment = get_name(path[i]);
+                if(segment.empty()) {
+                    // reference to self
+                    break;
+                }
+                if(value->is_object()) {
+                    value = value->as_object().if_contains(segment);
+                    if(!value) {
+                        return 0;
+                    }
+                } else if(value->is_array()) {
+                    return find_path_values(*value, path, i);
+                } else {
+                    return 0;
+                }
+            }
+            found_value = value;
+            return 1;
         }
 
-        void visit(const TextNode& node) {
-            output_stream->write(current_template->content.c_str() + node.pos, node.length);
+        // path goes through array: collect fields of all elements
+        size_t find_path_values(const json::value& array, const DataPath& path, size_t start) {
+            found_values.assign(1, &array);
+            for(size_t i = start; i < path.size() && !found_values.empty(); ++i) {
+                const auto& segment = get_name(path[i]);
+                if(segment.empty()) {
+                    break;
+                }
+                next_values.clear();
+                for(const auto* value : found_values) {
+                    if(value->is_array()) {
+                        for(const auto& element : value->as_array()) {
+                            if(element.is_object()) {
+                                if(const auto* field = element.as_object().if_contains(segment)) {
+                                    next_values.push_back(field);
+                                }
+                            }
+                        }
+                    } else if(value->is_object()) {
+                        if(const auto* field = value->as_object().if_contains(segment)) {
+                            next_values.push_back(field);
+                        }
+                    }
+                }
+                std::swap(found_values, next_values);
+            }
+            if(found_values.size() == 1) {
+                found_value = found_values.front();
+            }
+            return found_values.size();
         }
 
-        void visit(const CommentNode&) {}
-
-        void visit(const ExpressionNode&) {}
-
-        void visit(const LiteralNode& node) {
-            data_eval_stack.push(&node.value);
+        // variable of loop or set statement
+        void push_local(const Instruction& ins) {
+            const auto& local = current_program->locals[ins.extra];
+            const auto& slot = slots[local.slot];
+            if(slot.ref) {
+                const auto& path = current_program->paths[local.path];
+                if(path.empty() && current_program->slots[local.slot].kind == Slot::Kind::Loop) {
+                    // whole loop object is needed
+                    found_value = temporaries.make(make_loop_object(loop_level(local.slot)));
+                    push_found(ins, 1);
+                    return;
+                }
+                const size_t found = find_path(*slot.ref, path);
+                if(found != 0) {
+                    push_found(ins, found);
+                    return;
+                }
+            }
+            // variable isn't set yet or hasn't the field
+            push_data(ins, local.data_path);
         }
 
-        void visit(const DataNode& node){
-            // boost::system::error_code errcode;
-            // const auto* data = additional_data.find_pointer(node.path, errcode);
-            // if (!data){
-            //     data = input_data->find_pointer(node.path, errcode);    
-            // }
-            // if (!data) {
-            //     // Try to evaluate as a no-argument callback
-            //     const auto function_data = function_storage.find_function(node.name, 0);
-            //     if (function_data.operation == FunctionStorage::Operation::Callback) {
-            //         Arguments empty_args{};
-            //         const auto value = std::make_shared<json::value>(function_data.callback(empty_args));
-            //         add_checked_data(node, value.get());
-            //         return;
-            //     }
-            // } 
-            // add_checked_data(node, data);
-            auto data = boost::json::find_pointers(static_cast<const json::value&>(additional_data), node.name);
-            if (data.empty()){
-                data = boost::json::find_pointers(*input_data, node.name);    
-            }
-            if (data.empty()) {
+        void push_data(const Instruction& ins, uint32_t path_index) {
+            const auto& name = get_name(ins.arg);
+            const auto& path = current_program->paths[path_index];
+            size_t found = find_path(additional_data, path);
+            if (found == 0){
+                found = find_path(*input_data, path);
+            }
+            if (found == 0) {
                 // Try to evaluate as a no-argument callback
-                const auto function_data = function_storage.find_function(node.name, 0);
+                const auto function_data = function_storage.find_function(name, 0);
                 if (function_data.operation == FunctionStorage::Operation::Callback) {
                     Arguments empty_args{};
-                    const auto value = std::make_shared<json::value>(function_data.callback(empty_args));
-                    add_checked_data(node, value.get());
+                    add_checked_data(ins, temporaries.make(function_data.callback(empty_args)));
                     return;
                 }
             } 
+            push_found(ins, found);
+        }
+
+        // push result of find_path
+        void push_found(const Instruction& ins, size_t found) {
             // empty data
-            if(data.empty()) {
+            if(found == 0) {
                 // may be null is ok or default value is specified
-                add_checked_data(node, nullptr);
-            } else if(data.size() == 1) {
+                add_checked_data(ins, nullptr);
+            } else if(found == 1) {
                 // if result scalar then just use first value
-                add_checked_data(node, data.front());
+                add_checked_data(ins, found_value);
             } else {
                 // array of json pointers needs to convert in new json array 
                 // where each element is copy of original value (may be it's bad decision)
-                auto jarray = create_array_variable(data);
-                add_checked_data(node, jarray);
+                auto jarray = create_array_variable(found_values);
+                add_checked_data(ins, jarray);
             }
         }
 
-        void visit(const FunctionNode& node) {
-            switch (node.operation){
+        void call_function(const Instruction& ins, Arguments& args) {
+            switch (ins.operation){
             case Op::Not: 
                 {
-                    const auto args = get_arguments<1>(node);
                     make_result(!truthy(args[0]));
                 }
                 break;
-            case Op::And:
-                {
-                    make_result(truthy(get_arguments<1, 0>(node)[0]) && truthy(get_arguments<1, 1>(node)[0]));
-                }
-                break;
-            case Op::Or:
-                {
-                    make_result(truthy(get_arguments<1, 0>(node)[0]) || truthy(get_arguments<1, 1>(node)[0]));
-                }
-                break;
             case Op::In:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_array()) {
-                        throw_renderer_error("The 'in' function works only with array", node);
+                        throw_renderer_error("The 'in' function works only with array", ins.pos);
                     }
                     const auto& arr = args[1]->as_array();
                     make_result(std::find(arr.begin(), arr.end(), *args[0]) != arr.end());
@@ -421,157 +795,131 @@ namespace Wizard
                 break;
             case Op::Equal:
                 {
-                    const auto args = get_arguments<2>(node);
                     make_result(*args[0] == *args[1]);
                 }
                 break;
             case Op::NotEqual:
                 {
-                    const auto args = get_arguments<2>(node);
                     make_result(*args[0] != *args[1]);
                 }
                 break;
             case Op::Greater:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_string() && args[1]->is_string()){
                         make_result(args[0]->as_string() > args[1]->as_string());
                     } else if(args[0]->is_number() && args[1]->is_number()){
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) > 
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '>' operator works only with string or numbers", node);
+                        throw_renderer_error("The '>' operator works only with string or numbers", ins.pos);
                     }
                 }
                 break;
             case Op::GreaterEqual:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_string() && args[1]->is_string()){
                         make_result(args[0]->as_string() >= args[1]->as_string());
                     } else if(args[0]->is_number() && args[1]->is_number()){
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) >= 
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '>=' operator works only with string or numbers", node);
+                        throw_renderer_error("The '>=' operator works only with string or numbers", ins.pos);
                     }
                 }
                 break;
             case Op::Less:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_string() && args[1]->is_string()){
                         make_result(args[0]->as_string() < args[1]->as_string());
                     } else if(args[0]->is_number() && args[1]->is_number()){
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) <
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '<' operator works only with string or numbers", node);
+                        throw_renderer_error("The '<' operator works only with string or numbers", ins.pos);
                     }
                 }
                 break;
             case Op::LessEqual:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_string() && args[1]->is_string()){
                         make_result(args[0]->as_string() <= args[1]->as_string());
                     } else if(args[0]->is_number() && args[1]->is_number()){
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) <=
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '<=' operator works only with string or numbers", node);
+                        throw_renderer_error("The '<=' operator works only with string or numbers", ins.pos);
                     }
                 }
                 break;
             case Op::Add:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_string() && args[1]->is_string()){
-                        auto str = args[0]->as_string();
-                        str += args[1]->as_string();
-                        make_result(str);
+                        json::string str(args[0]->as_string(), storage());
+                        str.append(args[1]->as_string());
+                        make_result(json::value(std::move(str)));
                     } else if(args[0]->is_number() && args[1]->is_number()){
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) +
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '+' operator works only with string or numbers", node);
+                        throw_renderer_error("The '+' operator works only with string or numbers", ins.pos);
                     }
                 }
                 break;
             case Op::Subtract:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_number() && args[1]->is_number()) {
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) -
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '+' operator works only with numbers", node);
+                        throw_renderer_error("The '+' operator works only with numbers", ins.pos);
                     }
                 }
                 break;
             case Op::Multiplication:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_number() && args[1]->is_number()) {
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) *
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '*' operator works only with numbers", node);
+                        throw_renderer_error("The '*' operator works only with numbers", ins.pos);
                     }
                 }
                 break;
             case Op::Division:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_number() && args[1]->is_number()) {
                         if ((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) == 0) {
-                            throw_renderer_error("division by zero", node);
+                            throw_renderer_error("division by zero", ins.pos);
                         }
                         make_result((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()) /
                                     (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                     } else {
-                        throw_renderer_error("The '/' operator works only with numbers", node);
+                        throw_renderer_error("The '/' operator works only with numbers", ins.pos);
                     }
                 }
                 break;
             case Op::Power:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_number() && args[1]->is_number()) {
                         const auto result = std::pow((args[0]->is_double() ? args[0]->as_double() : args[0]->as_int64()), 
                                                      (args[1]->is_double() ? args[1]->as_double() : args[1]->as_int64()));
                         make_result(result);
                     } else {
-                        throw_renderer_error("The '^' operator works only with numbers", node);
+                        throw_renderer_error("The '^' operator works only with numbers", ins.pos);
                     }
                 }
                 break;
             case Op::Modulo:
                 {
-                    const auto args = get_arguments<2>(node);
                     if(args[0]->is_int64() && args[1]->is_int64()) {
                         make_result(args[0]->as_int64() % args[1]->as_int64());
                     } else {
-                        throw_renderer_error("The '%' operator works only with int numbers", node);
-                    }
-                }
-                break;
-            case Op::AtId: // through dot object.field
-                {
-                    const auto container = get_arguments<1, 0, false>(node)[0];
-                    node.arguments[1]->accept(*this);
-                    if(not_found_stack.empty()) {
-                        throw_renderer_error("could not find element with given name", node);
+                        throw_renderer_error("The '%' operator works only with int numbers", ins.pos);
                     }
-                    const auto id_node = not_found_stack.top();
-                    not_found_stack.pop();
-                    data_eval_stack.pop();
-                    data_eval_stack.push(&container->at(id_node->name));
                 }
                 break;
             case Op::At:
                 {
-                    const auto args = get_arguments<2>(node);
                     if (args[0]->is_object()){
                         data_eval_stack.push(&args[0]->at(args[1]->as_string()));
                     } else {
@@ -579,34 +927,26 @@ namespace Wizard
                     }
                 }
                 break;
-            case Op::Default:
-                {
-                    const auto test_arg = get_arguments<1, 0, false>(node)[0];
-                    data_eval_stack.push(test_arg ? test_arg : get_arguments<1, 1>(node)[0]);
-                }
-                break;
             case Op::DivisibleBy:
                 {
-                    const auto args = get_arguments<2>(node);
                     const auto divisor = args[1]->as_int64();
                     make_result((divisor != 0) && (args[0]->as_int64() % divisor == 0));
                 }
                 break;
             case Op::Even:
                 {
-                    make_result(get_arguments<1>(node)[0]->as_int64() % 2 == 0);
+                    make_result(args[0]->as_int64() % 2 == 0);
                 }
                 break;
             case Op::Exists:
                 {
-                    auto &&name = get_arguments<1>(node)[0]->as_string();
+                    auto &&name = args[0]->as_string();
                     boost::system::error_code ec;
                     make_result(input_data->find_pointer(convert_dot_to_ptr(name), ec) != nullptr);
                 }
                 break;
             case Op::ExistsInObject:
                 {
-                    const auto args = get_arguments<2>(node);
                     auto& obj = args[0]->as_object();
                     auto&& name = args[1]->as_string();
                     make_result(obj.find(name) != obj.end());
@@ -614,9 +954,8 @@ namespace Wizard
                 break;
             case Op::First:
                 {
-                    const auto args = get_arguments<1>(node);
                     if(!args[0]->is_array()) {
-                        throw_renderer_error("the 'first' function works only with array", node);
+                        throw_renderer_error("the 'first' function works only with array", ins.pos);
                     }
                     const auto& result = args[0]->get_array().front();
                     data_eval_stack.push(&result);
@@ -624,21 +963,20 @@ namespace Wizard
                 break;
             case Op::Float:
                 {
-                    const std::string&& number = static_cast<std::string>(get_arguments<1>(node)[0]->as_string());
+                    const std::string&& number = static_cast<std::string>(args[0]->as_string());
                     make_result(std::stod(number));
                 }
                 break;
             case Op::Int:
                 {
-                    const std::string&& number = static_cast<std::string>(get_arguments<1>(node)[0]->as_string());
+                    const std::string&& number = static_cast<std::string>(args[0]->as_string());
                     make_result(std::stoi(number));
                 }
                 break;
             case Op::Last:
                 {
-                    const auto args = get_arguments<1>(node);
                     if(!args[0]->is_array()) {
-                        throw_renderer_error("the 'last' function works only with array", node);
+                        throw_renderer_error("the 'last' function works only with array", ins.pos);
                     }
                     const auto& result = args[0]->get_array().back();
                     data_eval_stack.push(&result);
@@ -646,7 +984,7 @@ namespace Wizard
                 break;
             case Op::Length:
                 {
-                    const auto val = get_arguments<1>(node)[0];
+                    const auto val = args[0];
                     if (val->is_string()) {
                         make_result(val->as_string().size());
                     } else if (val->is_array()) {
@@ -654,55 +992,52 @@ namespace Wizard
                     } else if (val->is_object()) {
                         make_result(val->as_object().size());
                     } else {
-                        throw_renderer_error("the 'length' function works only with array, object, string", node);
+                        throw_renderer_error("the 'length' function works only with array, object, string", ins.pos);
                     }
                 }
                 break;
             case Op::Lower:
                 {
-                    auto result = get_arguments<1>(node)[0]->as_string();
+                    json::string result(args[0]->as_string(), storage());
                     std::transform(result.begin(), result.end(), result.begin(), [](char c)
                                 { return static_cast<char>(::tolower(c)); });
-                    make_result(std::move(result));
+                    make_result(json::value(std::move(result)));
                 }
                 break;
             case Op::Max:
                 {
-                    const auto args = get_arguments<1>(node);
                     if(!args[0]->is_array()) {
-                        throw_renderer_error("the 'first' function works only with array", node);
+                        throw_renderer_error("the 'first' function works only with array", ins.pos);
                     }
                     const auto& arr = args[0]->get_array();
-                    const auto result = std::max_element(arr.begin(), arr.end(), make_json_comparer(node));
+                    const auto result = std::max_element(arr.begin(), arr.end(), make_json_comparer(ins.pos));
                     data_eval_stack.push(&(*result));
                 }
                 break;
             case Op::Min:
                 {
-                    const auto args = get_arguments<1>(node);
                     if(!args[0]->is_array()) {
-                        throw_renderer_error("the 'first' function works only with array", node);
+                        throw_renderer_error("the 'first' function works only with array", ins.pos);
                     }
                     const auto& arr = args[0]->get_array();
-                    const auto result = std::min_element(arr.begin(), arr.end(), make_json_comparer(node));
+                    const auto result = std::min_element(arr.begin(), arr.end(), make_json_comparer(ins.pos));
                     data_eval_stack.push(&(*result));
                 }
                 break;
             case Op::Odd:
                 {
-                    make_result(get_arguments<1>(node)[0]->as_int64() % 2 != 0);
+                    make_result(args[0]->as_int64() % 2 != 0);
                 }
                 break;
             case Op::Range:
                 {
-                    std::vector<int> result(get_arguments<1>(node)[0]->as_int64());
+                    std::vector<int> result(args[0]->as_int64());
                     std::iota(result.begin(), result.end(), 0);
-                    make_result(json::array(result.begin(), result.end()));
+                    make_result(json::array(result.begin(), result.end(), storage()));
                 }
                 break;
             case Op::Round:
                 {
-                    const auto args = get_arguments<2>(node);
                     const auto precision = args[1]->as_int64();
                     const double result = std::round(args[0]->as_double() * std::pow(10.0, precision)) / std::pow(10.0, precision);
                     if(precision == 0) {
@@ -714,212 +1049,319 @@ namespace Wizard
                 break;
             case Op::Sort:
                 {
-                    const auto args = get_arguments<1>(node);
                     if(!args[0]->is_array()) {
-                        throw_renderer_error("The 'sort' function works only with array", node);
+                        throw_renderer_error("The 'sort' function works only with array", ins.pos);
                     }
-                    auto arr = args[0]->get_array();
-                    std::sort(arr.begin(), arr.end(), make_json_comparer(node));
-                    auto result_ptr = std::make_shared<json::value>(arr);
-                    data_tmp_stack.push_back(result_ptr);
-                    data_eval_stack.push(result_ptr.get());
+                    json::array arr(args[0]->get_array(), storage());
+                    std::sort(arr.begin(), arr.end(), make_json_comparer(ins.pos));
+                    make_result(json::value(std::move(arr)));
                 }
                 break;
             case Op::Upper:
                 {
-                    auto result = get_arguments<1>(node)[0]->as_string();
+                    json::string result(args[0]->as_string(), storage());
                     std::transform(result.begin(), result.end(), result.begin(), [](char c)
                                 { return static_cast<char>(::toupper(c)); });
-                    make_result(std::move(result));
+                    make_result(json::value(std::move(result)));
                 }
                 break;
             case Op::IsBoolean:
                 {
-                    make_result(get_arguments<1>(node)[0]->is_bool());
+                    make_result(args[0]->is_bool());
                 }
                 break;
             case Op::IsNumber:
                 {
-                    make_result(get_arguments<1>(node)[0]->is_number());
+                    make_result(args[0]->is_number());
                 }
                 break;
             case Op::IsInteger:
                 {
-                    make_result(get_arguments<1>(node)[0]->is_int64());
+                    make_result(args[0]->is_int64());
                 }
                 break;
             case Op::IsFloat:
                 {
-                    make_result(get_arguments<1>(node)[0]->is_double());
+                    make_result(args[0]->is_double());
                 }
                 break;
             case Op::IsObject:
                 {
-                    make_result(get_arguments<1>(node)[0]->is_object());
+                    make_result(args[0]->is_object());
                 }
                 break;
             case Op::IsArray:
                 {
-                    make_result(get_arguments<1>(node)[0]->is_array());
+                    make_result(args[0]->is_array());
                 }
                 break;
             case Op::IsString:
                 {
-                    make_result(get_arguments<1>(node)[0]->is_string());
+                    make_result(args[0]->is_string());
                 }
                 break;
             case Op::Callback:
                 {
-                    auto args = get_argument_vector(node);
-                    make_result(node.callback(args));
+                    make_result(current_program->callbacks[ins.extra](args));
                 }
                 break;
             case Op::Join:
                 {
-                    const auto args = get_arguments<2>(node);
                     const auto& arr = args[0]->as_array();
                     const auto& separator = args[1]->as_string();
-                    std::ostringstream os;
-                    std::string sep;
+                    // joined in storage of temporaries, other values are printed as json
+                    json::string result(storage());
                     for (const auto &value : arr) {
-                        os << sep;
+                        if (&value != arr.begin()) {
+                            result.append(separator);
+                        }
                         if (value.is_string()) {
-                            os << value.as_string().c_str(); // otherwise the value is surrounded with ""
+                            result.append(value.get_string()); // otherwise the value is surrounded with ""
                         } else {
-                            os << value;
+                            serializer.reset(&value);
+                            char buffer[256];
+                            while(!serializer.done()) {
+                                result.append(serializer.read(buffer));
+                            }
                         }
-                        sep = separator;
                     }
-                    make_result(json::value(os.str()));
+                    make_result(json::value(std::move(result)));
                 }
                 break;
             case Op::Split:
                 {
-                    const auto args = get_arguments<2>(node);
                     const auto& str = args[0]->as_string();
                     const auto& delim = args[1]->as_string();
                     auto parts = str | std::views::split(delim) 
                                      | std::views::transform([](auto r) {
                                         return std::string(r.data(), r.size());
                                        });
-                      make_result(json::array(parts.begin(), parts.end()));
+                      make_result(json::array(parts.begin(), parts.end(), storage()));
                 }
                 break;
+            case Op::And:
+            case Op::Or:
+            case Op::AtId:
+            case Op::Default:
             case Op::None:
+                // compiled into jumps (see Compiler)
                 break;
             }
         }
 
-        void visit(const StatementNode &) {
+        // start loop, returns false if there is nothing to iterate
+        bool begin_loop(const Instruction& ins) {
+            auto container = eval_result(ins.pos);
+            if (ins.code == OpCode::ForArray && !container->is_array()){
+                throw_renderer_error("object must be an array", ins.pos);
+            }
+            if (ins.code == OpCode::ForObject && !container->is_object()){
+                throw_renderer_error("object must be an object", ins.pos);
+            }
+            const size_t size = container->is_array() ? container->get_array().size() : container->get_object().size();
+            if(size == 0) {
+                return false;
+            }
+
+            if(container.is_owned()) {
+                // created by expression: temporaries are released before the loop body, the copy is freed with the loop
+                container = EvalResult(json::value(std::move(container).release(), json::storage_ptr()));
+            }
+            auto& frame = loop_stack.emplace_back();
+            frame.container = std::move(container);
+            frame.instruction = &ins;
+            frame.size = size;
+            auto& metadata = slots[ins.arg + 2];
+            if(!metadata.value.is_object()) {
+                // the same keys are reused when the loop is entered again (storage of render isn't freed until the end)
+                metadata.value = json::value(json::object_kind);
+            }
+            auto& loop_data = metadata.value.as_object();
+            loop_data["is_first"] = true;
+            loop_data["is_last"] = size <= 1;
+            loop_data["index"] = 0;
+            loop_data["index1"] = 1;
+            metadata.ref = &metadata.value;
+            bind_loop(frame);
+            return true;
         }
 
-        void visit(const ForStatementNode &) {
+        // set loop variables for current iteration
+        void bind_loop(LoopFrame& frame) {
+            const auto slot = frame.instruction->arg;
+            auto& loop_data = slots[slot + 2].value.as_object();
+            loop_data["index"] = frame.index;
+            loop_data["index1"] = frame.index + 1;
+            if(frame.index == 1) {
+                loop_data["is_first"] = false;
+            }
+            if(frame.index == frame.size - 1) {
+                loop_data["is_last"] = true;
+            }
+            if(frame.container->is_array()) {
+                slots[slot].ref = &frame.container->get_array()[frame.index];
+            } else {
+                const auto& item = *std::next(frame.container->get_object().begin(), frame.index);
+                auto& key = slots[slot + 1];
+                if(!key.value.is_string()) {
+                    key.value.emplace_string();
+                }
+                key.value.get_string() = item.key();
+                key.ref = &key.value;
+                slots[slot].ref = &item.value();
+            }
         }
 
-        void visit(const ForArrayStatementNode& node){
-            const auto result = eval_expression(node.condition);
-            if (!result->is_array()){
-                throw_renderer_error("object must be an array", node);
+        // returns true if loop body has to be executed again
+        bool next_loop() {
+            auto& frame = loop_stack.back();
+            if(++frame.index < frame.size) {
+                bind_loop(frame);
+                return true;
             }
-            const auto array_result = result->as_array();
+            end_loop();
+            return false;
+        }
 
-            json::object& data = additional_data.as_object();
-            json::object loop_data;
-            if(data.contains(config.loop_variable_name)){
-                loop_data["parent"] = data[config.loop_variable_name];
+        void end_loop() {
+            const auto slot = loop_stack.back().instruction->arg;
+            for(auto i = slot; i != slot + 3; ++i) {
+                slots[i].ref = nullptr;
             }
+            loop_stack.pop_back();
+        }
 
-            size_t index = 0;
-            loop_data["is_first"] = true;
-            loop_data["is_last"] = array_result.size() <= 1;
-            for(auto it = array_result.begin(); it != array_result.end(); ++it) {
+        // value is a part of root (the root itself or any nested array or object)
+        static bool contains(const json::value& root, const json::value* value) {
+            if(&root == value) {
+                return true;
+            }
+            if(root.is_array()) {
+                for(const auto& element : root.get_array()) {
+                    if(element.is_structured() && contains(element, value)) {
+                        return true;
+                    }
+                }
+            } else if(root.is_object()) {
+                for(const auto& item : root.get_object()) {
+                    if(item.value().is_structured() && contains(item.value(), value)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
 
-                loop_data["index"] = index;
-                loop_data["index1"] = index + 1;
-                if(index == 1) {
-                    loop_data["is_first"] = false;
+        // set statement replaces own value of slot, running loops which iterate a part of it switch to own copies
+        // (loops over input data or other variables keep borrowing)
+        void detach_loops(uint32_t slot) {
+            const auto& replaced = slots[slot].value;
+            if(!replaced.is_structured()) {
+                return;
+            }
+            std::vector<LoopFrame*> detached;
+            for(auto& frame : loop_stack) {
+                if(!frame.container.is_owned() && contains(replaced, frame.container.get())) {
+                    detached.push_back(&frame);
+                }
+            }
+            // copy all containers before rebinding (inner containers may be parts of outer ones)
+            for(auto frame : detached) {
+                frame->container.own();
+            }
+            for(auto& frame : loop_stack) {
+                if(std::find(detached.begin(), detached.end(), &frame) == detached.end()) {
+                    continue;
                 }
-                if(index == array_result.size() - 1) {
-                    loop_data["is_last"] = true;
+                auto& value = slots[frame.instruction->arg];
+                if(value.ref == &value.value) {
+                    // loop variable is changed by set statement
+                    continue;
+                }
+                if(frame.container->is_array()) {
+                    value.ref = &frame.container->get_array()[frame.index];
+                } else {
+                    value.ref = &std::next(frame.container->get_object().begin(), frame.index)->value();
                 }
-                data[node.value] = *it;
-                data[config.loop_variable_name] = loop_data;
-                node.body.accept(*this);
-                ++index;
             }
+        }
 
-            data.erase(node.value);
-            if(loop_data.contains("parent")) {
-                data[config.loop_variable_name] = loop_data["parent"];
+        void set_variable(const Instruction& ins, json::value&& value) {
+            auto& slot = slots[ins.arg];
+            const auto& pointer = get_name(ins.extra);
+            if(pointer.empty()) {
+                slot.value = std::move(value);
             } else {
-                data.erase(config.loop_variable_name);
+                if(!slot.ref) {
+                    slot.value = json::value(json::object_kind);
+                } else if(slot.ref != &slot.value) {
+                    // loop variable refers to data
+                    slot.value = *slot.ref;
+                }
+                slot.value.set_at_pointer(pointer, std::move(value));
             }
+            slot.ref = &slot.value;
         }
 
-        void visit(const ForObjectStatementNode& node)
-        {
-            const auto result = eval_expression(node.condition);
-            if(!result->is_object()) {
-                throw_renderer_error("object must be an object", node);
+        // position of loop in loop stack by slot of loop metadata
+        size_t loop_level(uint32_t slot) const {
+            for(size_t level = 0; level < loop_stack.size(); ++level) {
+                if(loop_stack[level].instruction->arg + 2 == slot) {
+                    return level;
+                }
             }
+            return 0;
+        }
 
-            const auto object_result = result->as_object();
-
-            json::object& data = additional_data.as_object();
-            json::object loop_data;
-            if(data.contains(config.loop_variable_name)){
-                loop_data["parent"] = data[config.loop_variable_name];
+        // loop metadata with parents
+        json::value make_loop_object(size_t level) const {
+            json::value result(json::object_kind, storage());
+            auto& data = result.as_object();
+            if(level > 0) {
+                data["parent"] = make_loop_object(level - 1);
+            } else if(const auto inherited = additional_data.as_object().if_contains(config.loop_variable_name)) {
+                data["parent"] = *inherited;
             }
-
-            size_t index = 0;
-            loop_data["is_first"] = true;
-            loop_data["is_last"] = object_result.size() <= 1;
-            for (auto it = object_result.begin(); it != object_result.end(); ++it) {
-                loop_data["index"] = index;
-                loop_data["index1"] = index + 1;
-                if(index == 1) {
-                    loop_data["is_first"] = false;
-                }
-                if(index == object_result.size() - 1) {
-                    loop_data["is_last"] = true;
-                }
-                data[node.key] = it->key();
-                data[node.value] = it->value();
-                data[config.loop_variable_name] = loop_data;
-                node.body.accept(*this);
-                ++index;
-            }
-
-            data.erase(node.key);
-            data.erase(node.value);
-            if(loop_data.contains("parent")) {
-                data[config.loop_variable_name] = loop_data["parent"];
-            } else {
-                data.erase(config.loop_variable_name);
+            for(const auto& item : slots[loop_stack[level].instruction->arg + 2].value.as_object()) {
+                data[item.key()] = item.value();
             }
+            return result;
         }
 
-        void visit(const IfStatementNode& node)
-        {
-            const auto result = eval_expression(node.condition);
-            if (truthy(result.get())){
-                node.true_statement.accept(*this);
-            }else if (node.has_false_statement) {
-                node.false_statement.accept(*this);
+        // variables for nested template: additional data, set variables and variables of running loops
+        json::value scope_data() const {
+            json::value scope(additional_data, storage());
+            auto& data = scope.as_object();
+            const auto& program_slots = current_program->slots;
+            for(size_t i = 0; i < slots.size(); ++i) {
+                if(program_slots[i].kind == Slot::Kind::Set && slots[i].ref) {
+                    data[get_name(program_slots[i].name)] = *slots[i].ref;
+                }
+            }
+            for(const auto& frame : loop_stack) {
+                const auto slot = frame.instruction->arg;
+                if(frame.instruction->code == OpCode::ForObject) {
+                    data[get_name(program_slots[slot + 1].name)] = *slots[slot + 1].ref;
+                }
+                data[get_name(program_slots[slot].name)] = *slots[slot].ref;
             }
+            if(!loop_stack.empty()) {
+                data[config.loop_variable_name] = make_loop_object(loop_stack.size() - 1);
+            }
+            return scope;
         }
 
-        void visit(const FileStatementNode& node) {
-            const auto filename = eval_expression(node.filename);
+        void begin_file(const Instruction& ins) {
+            const auto filename = eval_result(ins.pos);
             if(!filename->is_string()) {
-                throw_renderer_error("filename must be an string", node);
+                throw_renderer_error("filename must be an string", ins.pos);
             }
+            FileFrame frame{output};
             if(config.dry_run) {
                 // debug output to console
-                auto sfilename = static_cast<std::string>(filename->as_string());
-                *output_stream << ">>>>>> Start file: " << std::quoted(sfilename) << std::endl;
-                node.body.accept(*this);
-                *output_stream << "<<<<<< End file: " << std::quoted(sfilename) << std::endl;
+                frame.filename = static_cast<std::string>(filename->as_string());
+                print_file_marker(">>>>>> Start file: ", frame.filename);
+                file_stack.push(std::move(frame));
                 return;
             }
             // real work
@@ -930,35 +1372,57 @@ namespace Wizard
 
             if(!std::filesystem::exists(filepath.parent_path()) && 
                !std::filesystem::create_directories(filepath.parent_path())) {
-                throw_renderer_error("couldn't create output path", node);
+                throw_renderer_error("couldn't create output path", ins.pos);
             }
-            std::ofstream ofile;
-            ofile.open(filepath.c_str()); 
-            if(ofile.fail()) {
-                throw_renderer_error("couldn't create output file", node);
+            frame.file = std::make_unique<FileSink>(filepath);
+            if(frame.file->fail()) {
+                throw_renderer_error("couldn't create output file", ins.pos);
             }
-            file_stack.push(output_stream);
-            output_stream = &ofile;
-            node.body.accept(*this);
-            output_stream = file_stack.top();
+            output = frame.file.get();
+            file_stack.push(std::move(frame));
+        }
+
+        void end_file(const Instruction& ins) {
+            auto frame = std::move(file_stack.top());
             file_stack.pop();
+            output = frame.output;
+            if(config.dry_run) {
+                print_file_marker("<<<<<< End file: ", frame.filename);
+            } else if(frame.file) {
+                // the last buffered block is written here (write errors aren't lost in destructor)
+                try {
+                    frame.file->close();
+                } catch(FileError& err) {
+                    throw_renderer_error("couldn't write output file: " + err.message, ins.pos);
+                }
+            }
         }
 
-        void visit(const ApplyTemplateStatementNode& node) {
+        // dry run: begin/end of file
+        void print_file_marker(std::string_view marker, const std::string& filename) {
+            std::ostringstream line;
+            line << marker << std::quoted(filename) << '\n';
+            output->write(line.view());
+        }
+
+        void apply_template(const Instruction& ins) {
+            const auto& template_name = current_program->templates[ins.arg];
+            const auto& field_path = get_name(ins.extra);
             // find data
             boost::system::error_code errcode;
-            if(!input_data->find_pointer(node.field_path, errcode)) {
+            if(!input_data->find_pointer(field_path, errcode)) {
                 return; // no field is OK ?????
             }
 
             // find template
-            const auto template_it = template_storage.find(node.template_name);
+            const auto template_it = template_storage.find(template_name);
             if (template_it != template_storage.end()){
                 // find data
-                auto& subdata = input_data->at_pointer(node.field_path);
+                auto& subdata = input_data->at_pointer(field_path);
+                json::value scope = scope_data();
                 if(subdata.is_array()) {
-                    json::object& data = additional_data.as_object();
-                    json::object loop_data;
+                    json::object& data = scope.as_object();
+                    json::object loop_data{};
                     if (data.contains(config.loop_variable_name)) {
                         loop_data["parent"] = data[config.loop_variable_name];
                     }
@@ -967,6 +1431,10 @@ namespace Wizard
                     auto& subarr = subdata.get_array();
                     loop_data["is_first"] = true;
                     loop_data["is_last"] = subarr.size() <= 1;
+                    if(apply_template_jobs != 1 && subarr.size() > 1) {
+                        apply_template_parallel(template_it->second, subarr, scope, loop_data);
+                        return;
+                    }
                     for(auto i = 0ul; i != subarr.size(); ++i) {
                         loop_data["index"] = i;
                         loop_data["index1"] = i + 1;
@@ -978,47 +1446,60 @@ namespace Wizard
                         }
                         data[config.loop_variable_name] = loop_data;
                         auto sub_renderer = Renderer(config, template_storage, function_storage);
-                        sub_renderer.render(*output_stream, template_it->second, subarr[i], &additional_data);
-                    }
-                    if (loop_data.contains("parent")) {
-                        data[config.loop_variable_name] = loop_data["parent"];
-                    } else {
-                        data.erase(config.loop_variable_name);
+                        sub_renderer.render(*output, template_it->second, subarr[i], &scope);
                     }
-
                 } else {
                     // render template
                     auto sub_renderer = Renderer(config, template_storage, function_storage);
-                    sub_renderer.render(*output_stream, template_it->second, subdata, &additional_data);
+                    sub_renderer.render(*output, template_it->second, subdata, &scope);
                 }
             } else if (config.throw_at_missing_includes) {
-                throw_renderer_error("apply template '" + node.template_name.string() + "' not found", node);
+                throw_renderer_error("apply template '" + template_name.string() + "' not found", ins.pos);
             }
         }
-
-        void visit(const SetStatementNode &node){
-            std::string ptr = convert_dot_to_ptr(node.key);
-            additional_data.set_at_pointer(ptr, *eval_expression(node.expression));
-        }
  
-        json::value convert_value(const Variable::Type& type, const json::value& value)
+        // elements are rendered to own buffers by worker threads, the output keeps order of elements
+        void apply_template_parallel(const Template& tmpl, const json::array& elements,
+                                     const json::value& scope, const json::object& loop_data) {
+            std::vector<std::string> buffers(elements.size());
+            parallel_for(elements.size(), apply_template_jobs, [&](size_t i) {
+                // the arena of this render isn't thread-safe, copies use default memory resource
+                json::value element_scope(scope, json::storage_ptr());
+                json::object element_loop = loop_data;
+                element_loop["index"] = i;
+                element_loop["index1"] = i + 1;
+                element_loop["is_first"] = i == 0;
+                element_loop["is_last"] = i == elements.size() - 1;
+                element_scope.as_object()[config.loop_variable_name] = std::move(element_loop);
+
+                auto sub_renderer = Renderer(config, template_storage, function_storage);
+                sub_renderer.apply_template_jobs = 1;
+                StringSink sink(buffers[i]);
+                sub_renderer.render(sink, tmpl, elements[i], &element_scope);
+            });
+            for(const auto& buffer : buffers) {
+                output->write(buffer);
+            }
+        }
+
+        json::value convert_value(const Variable::Type& type, const json::value& value, const json::storage_ptr& sp)
         {
             switch(value.kind()) {
             case json::kind::null: {
                     // null
                     switch(type){
                     case Variable::Type::Boolean:
-                        return json::value(false);
+                        return json::value(false, sp);
                     case Variable::Type::Integer:
-                        return json::value(0);
+                        return json::value(0, sp);
                     case Variable::Type::Double:
-                        return json::value(0.0);
+                        return json::value(0.0, sp);
                     case Variable::Type::String:
-                        return json::value("");
+                        return json::value("", sp);
                     case Variable::Type::Array:
-                        return json::value(json::array_kind);
+                        return json::value(json::array_kind, sp);
                     case Variable::Type::Object:
-                        return json::value(json::object_kind);
+                        return json::value(json::object_kind, sp);
                     case Variable::Type::Null:
                         return {};
                     }
@@ -1029,18 +1510,18 @@ namespace Wizard
                     auto bvalue = value.as_bool();
                     switch(type){
                     case Variable::Type::Boolean:
-                        return json::value(bvalue);
+                        return json::value(bvalue, sp);
                     case Variable::Type::Integer:
-                        return json::value(bvalue ? 0 : 1);
+                        return json::value(bvalue ? 0 : 1, sp);
                     case Variable::Type::Double: {
                             std::string message = "Cannot convert bool value to double";
                             throw BaseError("data_error", message);
                         }
                     case Variable::Type::String:
-                        return json::value(bvalue ? "true" : "false");
+                        return json::value(bvalue ? "true" : "false", sp);
                     case Variable::Type::Array:
                         //return json::value(json::array_kind);
-                        return json::value({{bvalue}});
+                        return json::value({{bvalue}}, sp);
                     case Variable::Type::Object: {
                             std::string message = "Cannot convert bool value to object";
                             throw BaseError("data_error", message);
@@ -1055,15 +1536,15 @@ namespace Wizard
                     auto ivalue = value.as_int64();
                     switch(type){
                     case Variable::Type::Boolean:
-                        return json::value(ivalue != 0);
+                        return json::value(ivalue != 0, sp);
                     case Variable::Type::Integer:
-                        return json::value(ivalue);
+                        return json::value(ivalue, sp);
                     case Variable::Type::Double:
-                        return json::value(ivalue * 1.0);
+                        return json::value(ivalue * 1.0, sp);
                     case Variable::Type::String:
-                        return json::value(std::to_string(ivalue));
+                        return json::value(std::to_string(ivalue), sp);
                     case Variable::Type::Array:
-                        return json::value({{ivalue}});
+                        return json::value({{ivalue}}, sp);
                     case Variable::Type::Object: {
                             std::string message = "Cannot convert int value to object";
                             throw BaseError("data_error", message);
@@ -1078,15 +1559,15 @@ namespace Wizard
                     auto ivalue = value.as_uint64();
                     switch(type){
                     case Variable::Type::Boolean:
-                        return json::value(ivalue != 0);
+                        return json::value(ivalue != 0, sp);
                     case Variable::Type::Integer:
-                        return json::value(ivalue);
+                        return json::value(ivalue, sp);
                     case Variable::Type::Double:
-                        return json::value(ivalue * 1.0);
+                        return json::value(ivalue * 1.0, sp);
                     case Variable::Type::String:
-                        return json::value(std::to_string(ivalue));
+                        return json::value(std::to_string(ivalue), sp);
                     case Variable::Type::Array:
-                        return json::value({{ivalue}});
+                        return json::value({{ivalue}}, sp);
                     case Variable::Type::Object: {
                             std::string message = "Cannot convert unsigned int value to object";
                             throw BaseError("data_error", message);
@@ -1105,13 +1586,13 @@ namespace Wizard
                             throw BaseError("data_error", message);
                         }
                     case Variable::Type::Integer:
-                        return json::value(static_cast<int>(dvalue));
+                        return json::value(static_cast<int>(dvalue), sp);
                     case Variable::Type::Double:
-                        return json::value(dvalue);
+                        return json::value(dvalue, sp);
                     case Variable::Type::String:
-                        return json::value(std::to_string(dvalue));
+                        return json::value(std::to_string(dvalue), sp);
                     case Variable::Type::Array:
-                        return json::value({{dvalue}});
+                        return json::value({{dvalue}}, sp);
                     case Variable::Type::Object:{
                             std::string message = "Cannot convert unsigned int value to object";
                             throw BaseError("data_error", message);
@@ -1126,15 +1607,15 @@ namespace Wizard
                     std::string svalue = value.as_string().c_str();
                     switch(type){
                     case Variable::Type::Boolean:
-                        return json::value(svalue == "true" ? true : false);
+                        return json::value(svalue == "true" ? true : false, sp);
                     case Variable::Type::Integer:
-                        return json::value(std::stoi(svalue));
+                        return json::value(std::stoi(svalue), sp);
                     case Variable::Type::Double:
-                        return json::value(std::stod(svalue));
+                        return json::value(std::stod(svalue), sp);
                     case Variable::Type::String:
-                        return json::value(svalue);
+                        return json::value(svalue, sp);
                     case Variable::Type::Array:
-                        return json::value({{svalue}});
+                        return json::value({{svalue}}, sp);
                     case Variable::Type::Object: {
                             std::string message = "Cannot convert string value to object";
                             throw BaseError("data_error", message);
@@ -1149,7 +1630,7 @@ namespace Wizard
                     auto& arr = value.as_array();
                     switch(type){
                     case Variable::Type::Boolean:
-                        return json::value(!arr.empty());
+                        return json::value(!arr.empty(), sp);
                     case Variable::Type::Integer:{
                             std::string message = "Cannot convert array value to integer";
                             throw BaseError("data_error", message);
@@ -1161,7 +1642,7 @@ namespace Wizard
                     case Variable::Type::String:{
                             std::string str;
                             for(auto val: arr){
-                                auto sval = convert_value(Variable::Type::String, val);
+                                auto sval = convert_value(Variable::Type::String, val, sp);
                                 if(!str.empty()) {
                                     str += ", ";
                                 }
@@ -1170,10 +1651,10 @@ namespace Wizard
                                 str += "\"";
                             }		
                             str = "[" + str + "]";
-                            return json::value(str);
+                            return json::value(str, sp);
                     }
                     case Variable::Type::Array:
-                        return arr;
+                        return json::value(arr, sp);
                     case Variable::Type::Object:{
                             std::string message = "Cannot convert array value to object";
                             throw BaseError("data_error", message);
@@ -1188,7 +1669,7 @@ namespace Wizard
                     auto& obj = value.as_object();
                     switch(type){
                     case Variable::Type::Boolean:
-                        return json::value(!obj.empty());
+                        return json::value(!obj.empty(), sp);
                     case Variable::Type::Integer:{
                             std::string message = "Cannot convert object value to integer";
                             throw BaseError("data_error", message);
@@ -1200,7 +1681,7 @@ namespace Wizard
                     case Variable::Type::String:{
                             std::string str;
                             for(const auto& [key, val]: obj){
-                                auto sval = convert_value(Variable::Type::String, val);
+                                auto sval = convert_value(Variable::Type::String, val, sp);
                                 if(!str.empty()) {
                                     str += ", ";
                                 }
@@ -1211,12 +1692,12 @@ namespace Wizard
                                 str += "\"";
                             }		
                             str = "{" + str + "}";
-                            return json::value(str);
+                            return json::value(str, sp);
                         }
                     case Variable::Type::Array:
-                        return json::value({{obj}});
+                        return json::value({{obj}}, sp);
                     case Variable::Type::Object:
-                        return obj;
+                        return json::value(obj, sp);
                     case Variable::Type::Null:
                         return {};
                     }
@@ -9,15 +9,18 @@ namespace json = boost::json;
 
 #include "Node.h"
 #include "Desc.h"
+#include "Bytecode.h"
 
 namespace Wizard
 {
     struct Template
     {
+        std::shared_ptr<NodeArena> arena{std::make_shared<NodeArena>()}; // owns nodes of root
         BlockNode root;
         std::string content;
         std::filesystem::path path;
         Description desc;
+        std::shared_ptr<const Program> program; // compiled root (see Compiler)
         
         explicit Template() {}
         explicit Template(const std::string& content, 
@@ -0,0 +1,432 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <fstream>
+#include <boost/json/parse.hpp>
+#include <boost/json/serialize.hpp>
+namespace json = boost::json;
+
+#include "Exceptions.h"
+#include "Util.h"
+#include "Node.h"
+#include "Template.h"
+#include "Compiler.h"
+#include "FunctionStorage.h"
+
+namespace Wizard
+{
+    // Precompiled template file (.wzc): AST, content, description and nested templates
+    //
+    // layout: magic, version, number of templates, templates (the first is the main template)
+    // template: storage name, path, content, description (json), root block
+    class TemplateArchive
+    {
+        static constexpr std::string_view magic{"WZC"};
+        static constexpr uint8_t version{1};
+
+        enum class NodeTag : uint8_t {
+            Text,
+            Comment,
+            Expression,
+            Literal,
+            Data,
+            Function,
+            ExpressionWrapper,
+            If,
+            ForArray,
+            ForObject,
+            File,
+            ApplyTemplate,
+            Set,
+        };
+
+        class Writer : public NodeVisitor
+        {
+            std::string& out;
+
+        public:
+            std::set<std::filesystem::path> nested; // applied templates
+
+            explicit Writer(std::string& out) : out(out) {}
+
+            template <typename T>
+            void put(T value) {
+                out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+            }
+
+            void put_string(std::string_view str) {
+                put<uint64_t>(str.size());
+                out.append(str);
+            }
+
+            void put_header(NodeTag tag, const AstNode& node) {
+                put(tag);
+                put<uint64_t>(node.pos);
+            }
+
+            void put_block(const BlockNode& block) {
+                put<uint64_t>(block.nodes.size());
+                for (auto& child : block.nodes) {
+                    child->accept(*this);
+                }
+            }
+
+            void put_wrapper(const ExpressionWrapperNode& node) {
+                put<uint64_t>(node.pos);
+                put<uint8_t>(node.root != nullptr);
+                if (node.root) {
+                    node.root->accept(*this);
+                }
+            }
+
+            void put_template(const std::filesystem::path& name, const Template& tmpl) {
+                put_string(name.generic_string());
+                put_string(tmpl.path.generic_string());
+                put_string(tmpl.content);
+                const bool has_desc = !tmpl.desc.name.empty();
+                put<uint8_t>(has_desc);
+                if (has_desc) {
+                    put_string(json::serialize(tmpl.desc.create_json_object()));
+                }
+                put_block(tmpl.root);
+            }
+
+        protected:
+            void visit(const BlockNode& node) {
+                put_block(node);
+            }
+
+            void visit(const TextNode& node) {
+                put_header(NodeTag::Text, node);
+                put<uint64_t>(node.length);
+            }
+
+            void visit(const CommentNode& node) {
+                put_header(NodeTag::Comment, node);
+                put<uint64_t>(node.length);
+            }
+
+            void visit(const ExpressionNode& node) {
+                put_header(NodeTag::Expression, node);
+            }
+
+            void visit(const LiteralNode& node) {
+                put_header(NodeTag::Literal, node);
+                put_string(json::serialize(node.value));
+            }
+
+            void visit(const DataNode& node) {
+                put_header(NodeTag::Data, node);
+                put_string(node.name);
+            }
+
+            void visit(const FunctionNode& node) {
+                put_header(NodeTag::Function, node);
+                put(node.operation);
+                put_string(node.name);
+                put<int32_t>(node.number_args);
+                put<uint32_t>(node.precedence);
+                put(node.associativity);
+                put<uint64_t>(node.arguments.size());
+                for (auto& argument : node.arguments) {
+                    argument->accept(*this);
+                }
+            }
+
+            void visit(const ExpressionWrapperNode& node) {
+                put(NodeTag::ExpressionWrapper);
+                put_wrapper(node);
+            }
+
+            void visit(const StatementNode&) {}
+
+            void visit(const ForStatementNode&) {}
+
+            void visit(const ForArrayStatementNode& node) {
+                put_header(NodeTag::ForArray, node);
+                put_string(node.value);
+                put_wrapper(node.condition);
+                put_block(node.body);
+            }
+
+            void visit(const ForObjectStatementNode& node) {
+                put_header(NodeTag::ForObject, node);
+                put_string(node.key);
+                put_string(node.value);
+                put_wrapper(node.condition);
+                put_block(node.body);
+            }
+
+            void visit(const IfStatementNode& node) {
+                put_header(NodeTag::If, node);
+                put<uint8_t>(node.is_nested);
+                put<uint8_t>(node.has_false_statement);
+                put_wrapper(node.condition);
+                put_block(node.true_statement);
+                put_block(node.false_statement);
+            }
+
+            void visit(const FileStatementNode& node) {
+                put_header(NodeTag::File, node);
+                put_wrapper(node.filename);
+                put_block(node.body);
+            }
+
+            void visit(const ApplyTemplateStatementNode& node) {
+                put_header(NodeTag::ApplyTemplate, node);
+                put_string(node.template_name.generic_string());
+                put_string(node.field_name);
+                nested.insert(node.template_name);
+            }
+
+            void visit(const SetStatementNode& node) {
+                put_header(NodeTag::Set, node);
+                put_string(node.key);
+                put_wrapper(node.expression);
+            }
+        };
+
+        class Reader
+        {
+            std::string_view in;
+            size_t offset{0};
+            const FunctionStorage& function_storage;
+            NodeArena* arena{nullptr};
+
+        public:
+            explicit Reader(std::string_view in, const FunctionStorage& function_storage)
+                : in(in), function_storage(function_storage) {}
+
+            void check(size_t size) {
+                if (in.size() - offset < size) {
+                    throw FileError("corrupted precompiled template");
+                }
+            }
+
+            template <typename T>
+            T get() {
+                check(sizeof(T));
+                T value;
+                std::memcpy(&value, in.data() + offset, sizeof(T));
+                offset += sizeof(T);
+                return value;
+            }
+
+            std::string_view get_string() {
+                const auto size = get<uint64_t>();
+                check(size);
+                std::string_view result = in.substr(offset, size);
+                offset += size;
+                return result;
+            }
+
+            void get_block(BlockNode& block) {
+                const auto count = get<uint64_t>();
+                for (uint64_t i = 0; i < count; ++i) {
+                    block.nodes.push_back(get_node(&block));
+                }
+            }
+
+            void get_wrapper(ExpressionWrapperNode& node) {
+                node.pos = get<uint64_t>();
+                if (get<uint8_t>()) {
+                    node.root = get_expression();
+                }
+            }
+
+            ExpressionNode* get_expression() {
+                auto expression = dynamic_cast<ExpressionNode*>(get_node(nullptr));
+                if (!expression) {
+                    throw FileError("corrupted precompiled template: expression expected");
+                }
+                return expression;
+            }
+
+            AstNode* get_node(BlockNode* parent) {
+                const auto tag = get<NodeTag>();
+                if (tag == NodeTag::ExpressionWrapper) {
+                    auto node = arena->make<ExpressionWrapperNode>();
+                    get_wrapper(*node);
+                    return node;
+                }
+                const size_t pos = get<uint64_t>();
+                switch (tag) {
+                case NodeTag::Text:
+                    return arena->make<TextNode>(pos, get<uint64_t>());
+                case NodeTag::Comment:
+                    return arena->make<CommentNode>(pos, get<uint64_t>());
+                case NodeTag::Expression:
+                    return arena->make<ExpressionNode>(pos);
+                case NodeTag::Literal:
+                    return arena->make<LiteralNode>(get_string(), pos);
+                case NodeTag::Data:
+                    return arena->make<DataNode>(get_string(), pos);
+                case NodeTag::Function:
+                    {
+                        const auto operation = get<FunctionStorage::Operation>();
+                        auto node = arena->make<FunctionNode>(get_string(), pos);
+                        node->operation = operation;
+                        node->number_args = get<int32_t>();
+                        node->precedence = get<uint32_t>();
+                        node->associativity = get<FunctionStorage::Associativity>();
+                        const auto count = get<uint64_t>();
+                        for (uint64_t i = 0; i < count; ++i) {
+                            node->arguments.push_back(get_expression());
+                        }
+                        if (operation == FunctionStorage::Operation::Callback) {
+                            // user functions are bound again by name
+                            auto function_data = function_storage.find_function(node->name, node->number_args);
+                            if (function_data.operation != FunctionStorage::Operation::Callback) {
+                                throw FileError("unknown function " + node->name + " in precompiled template");
+                            }
+                            node->callback = function_data.callback;
+                        }
+                        return node;
+                    }
+                case NodeTag::ForArray:
+                    {
+                        auto node = arena->make<ForArrayStatementNode>(static_cast<std::string>(get_string()), parent, pos);
+                        get_wrapper(node->condition);
+                        get_block(node->body);
+                        return node;
+                    }
+                case NodeTag::ForObject:
+                    {
+                        auto key = static_cast<std::string>(get_string());
+                        auto node = arena->make<ForObjectStatementNode>(key, static_cast<std::string>(get_string()), parent, pos);
+                        get_wrapper(node->condition);
+                        get_block(node->body);
+                        return node;
+                    }
+                case NodeTag::If:
+                    {
+                        const bool is_nested = get<uint8_t>();
+                        auto node = arena->make<IfStatementNode>(is_nested, parent, pos);
+                        node->has_false_statement = get<uint8_t>();
+                        get_wrapper(node->condition);
+                        get_block(node->true_statement);
+                        get_block(node->false_statement);
+                        return node;
+                    }
+                case NodeTag::File:
+                    {
+                        auto node = arena->make<FileStatementNode>(parent, pos);
+                        get_wrapper(node->filename);
+                        get_block(node->body);
+                        return node;
+                    }
+                case NodeTag::ApplyTemplate:
+                    {
+                        std::filesystem::path name = get_string();
+                        return arena->make<ApplyTemplateStatementNode>(name, static_cast<std::string>(get_string()), pos);
+                    }
+                case NodeTag::Set:
+                    {
+                        auto node = arena->make<SetStatementNode>(static_cast<std::string>(get_string()), pos);
+                        get_wrapper(node->expression);
+                        return node;
+                    }
+                default:
+                    break;
+                }
+                throw FileError("corrupted precompiled template: unknown node");
+            }
+
+            std::pair<std::filesystem::path, Template> get_template() {
+                std::filesystem::path name = get_string();
+                std::filesystem::path path = get_string();
+                Template tmpl(static_cast<std::string>(get_string()), path);
+                if (get<uint8_t>()) {
+                    std::error_code ec;
+                    auto jdesc = json::parse(get_string(), ec);
+                    if (ec || !jdesc.is_object()) {
+                        throw FileError("corrupted precompiled template: description");
+                    }
+                    tmpl.desc = Description::load_from_json(jdesc.as_object());
+                }
+                arena = tmpl.arena.get();
+                get_block(tmpl.root);
+                arena = nullptr;
+                tmpl.program = Compiler::compile(tmpl);
+                return {name, std::move(tmpl)};
+            }
+        };
+
+    public:
+        static constexpr std::string_view extension{".wzc"};
+
+        static bool is_archive(const std::filesystem::path& path) {
+            return path.extension() == extension;
+        }
+
+        // write template and its nested templates (found in storage)
+        static void save(const std::filesystem::path& path, const Template& tmpl, const TemplateStorage& storage) {
+            std::string body;
+            Writer writer(body);
+            writer.put_template(tmpl.path, tmpl);
+            uint64_t count = 1;
+            std::set<std::filesystem::path> written;
+            std::queue<std::filesystem::path> pending;
+            for (auto& name : writer.nested) {
+                pending.push(name);
+            }
+            while (!pending.empty()) {
+                auto name = pending.front();
+                pending.pop();
+                if (!written.insert(name).second) {
+                    continue;
+                }
+                auto it = storage.find(name);
+                if (it == storage.end()) {
+                    continue; // rendering reports missing template
+                }
+                writer.nested.clear();
+                writer.put_template(name, it->second);
+                count += 1;
+                for (auto& nested : writer.nested) {
+                    pending.push(nested);
+                }
+            }
+
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (file.fail()) {
+                throw FileError("Couldn't create file: \"" + path.string() + "\"");
+            }
+            file.write(magic.data(), magic.size());
+            file.put(static_cast<char>(version));
+            file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            file.write(body.data(), static_cast<std::streamsize>(body.size()));
+            if (file.fail()) {
+                throw FileError("Couldn't write file: \"" + path.string() + "\"");
+            }
+        }
+
+        // read template, nested templates are added in storage (if they are absent)
+        static Template load(const std::filesystem::path& path, TemplateStorage& storage, const FunctionStorage& function_storage) {
+            MappedFile file(path);
+            if (!file.view().starts_with(magic)) {
+                throw FileError("\"" + path.string() + "\" isn't a precompiled template");
+            }
+            Reader reader(file.view().substr(magic.size()), function_storage);
+            if (reader.get<uint8_t>() != version) {
+                throw FileError("\"" + path.string() + "\" has unsupported version");
+            }
+            const auto count = reader.get<uint64_t>();
+            if (count == 0) {
+                throw FileError("corrupted precompiled template");
+            }
+            auto [main_name, result] = reader.get_template();
+            for (uint64_t i = 1; i < count; ++i) {
+                auto [name, tmpl] = reader.get_template();
+                storage.emplace(name, std::move(tmpl));
+            }
+            return std::move(result);
+        }
+    };
+
+} // namespace Wizard
@@ -0,0 +1,197 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <filesystem>
+#include <functional>
+#include "Config.h"
+#include "Template.h"
+#include "Util.h"
+
+namespace Wizard
+{
+    // Parsed templates of files (checked by modification time and content hash)
+    // nested template files and description file are checked by modification time and size
+    class TemplateCache
+    {
+    public:
+        // file used by cached template
+        struct Dependency {
+            std::filesystem::path name;     // nested template name (empty for description file)
+            std::filesystem::path file;
+        };
+
+    private:
+        struct FileStamp {
+            std::filesystem::path name;
+            std::filesystem::path file;
+            std::filesystem::file_time_type mtime{};
+            std::uintmax_t size{static_cast<std::uintmax_t>(-1)}; // -1 - file doesn't exist
+
+            bool operator==(const FileStamp&) const = default;
+        };
+
+        struct Key {
+            std::filesystem::path file;     // normalized path
+            std::filesystem::path infofile; // template description
+            bool keep_comments;
+            bool parse_nested_template;
+
+            auto operator<=>(const Key&) const = default;
+        };
+
+        struct Entry {
+            LexerConfig lconfig;
+            std::filesystem::file_time_type mtime;
+            std::uintmax_t size;
+            size_t hash;
+            Template tmpl;
+            std::vector<FileStamp> dependencies;
+        };
+
+        std::map<Key, Entry> entries;
+
+        static size_t content_hash(std::string_view content) {
+            return std::hash<std::string_view>{}(content);
+        }
+
+        static FileStamp make_stamp(const Dependency& dependency) {
+            FileStamp stamp{dependency.name, dependency.file};
+            std::error_code ec;
+            const auto mtime = std::filesystem::last_write_time(dependency.file, ec);
+            if(ec) {
+                return stamp;
+            }
+            const auto size = std::filesystem::file_size(dependency.file, ec);
+            if(!ec) {
+                stamp.mtime = mtime;
+                stamp.size = size;
+            }
+            return stamp;
+        }
+
+        static bool is_changed(const FileStamp& stamp) {
+            return make_stamp({stamp.name, stamp.file}) != stamp;
+        }
+
+        // template file is the same as parsed one
+        static bool is_current(Entry& entry, const std::filesystem::path& filepath) {
+            std::error_code ec;
+            const auto mtime = std::filesystem::last_write_time(filepath, ec);
+            if(ec) {
+                return false;
+            }
+            const auto size = std::filesystem::file_size(filepath, ec);
+            if(ec) {
+                return false;
+            }
+            if(mtime == entry.mtime && size == entry.size) {
+                return true;
+            }
+            // file is touched, compare content
+            std::ifstream file(filepath, std::ios::binary);
+            if(file.fail()) {
+                return false;
+            }
+            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if(content_hash(content) != entry.hash || content != entry.tmpl.content) {
+                return false;
+            }
+            entry.mtime = mtime;
+            entry.size = size;
+            return true;
+        }
+
+        static Key make_key(const std::filesystem::path& file, const std::filesystem::path& infofile, const ParserConfig& pconfig) {
+            return Key{file.lexically_normal(), infofile.lexically_normal(), pconfig.keep_comments, pconfig.parse_nested_template};
+        }
+
+    public:
+        // full path of template file
+        static std::filesystem::path file_path(const std::filesystem::path& path, const LexerConfig& lconfig) {
+            std::filesystem::path filepath = lconfig.templates_dir;
+            filepath /= path;
+            return filepath.lexically_normal();
+        }
+
+        // cached template or nullptr (not parsed, file or config is changed)
+        const Template* find(const std::filesystem::path& path, const std::filesystem::path& infofile,
+                             const LexerConfig& lconfig, const ParserConfig& pconfig) {
+            const auto filepath = file_path(path, lconfig);
+            auto it = entries.find(make_key(filepath, infofile, pconfig));
+            if(it == entries.end()) {
+                return nullptr;
+            }
+            auto& entry = it->second;
+            if(!(entry.lconfig == lconfig) || !is_current(entry, filepath)) {
+                return nullptr;
+            }
+            for(const auto& stamp : entry.dependencies) {
+                if(is_changed(stamp)) {
+                    return nullptr;
+                }
+            }
+            return &entry.tmpl;
+        }
+
+        // names of nested templates changed since the template was cached
+        std::vector<std::filesystem::path> changed_dependencies(const std::filesystem::path& path, const std::filesystem::path& infofile,
+                                                                const LexerConfig& lconfig, const ParserConfig& pconfig) const {
+            std::vector<std::filesystem::path> result;
+            const auto it = entries.find(make_key(file_path(path, lconfig), infofile, pconfig));
+            if(it != entries.end()) {
+                for(const auto& stamp : it->second.dependencies) {
+                    if(!stamp.name.empty() && is_changed(stamp)) {
+                        result.push_back(stamp.name);
+                    }
+                }
+            }
+            return result;
+        }
+
+        const Template& insert(const std::filesystem::path& path, const std::filesystem::path& infofile,
+                               const LexerConfig& lconfig, const ParserConfig& pconfig, const Template& tmpl,
+                               const std::vector<Dependency>& dependencies = {}) {
+            const auto filepath = file_path(path, lconfig);
+            std::error_code ec;
+            Entry entry{lconfig, std::filesystem::last_write_time(filepath, ec), 0, content_hash(tmpl.content), tmpl, {}};
+            entry.size = std::filesystem::file_size(filepath, ec);
+            if(ec) {
+                entry.size = static_cast<std::uintmax_t>(-1); // always check content
+            }
+            for(const auto& dependency : dependencies) {
+                entry.dependencies.push_back(make_stamp(dependency));
+            }
+            auto [it, inserted] = entries.insert_or_assign(make_key(filepath, infofile, pconfig), std::move(entry));
+            return it->second.tmpl;
+        }
+
+        // remove all cached variants of file
+        void invalidate(const std::filesystem::path& path, const LexerConfig& lconfig) {
+            const auto filepath = file_path(path, lconfig);
+            std::erase_if(entries, [&filepath](const auto& item) {
+                return item.first.file == filepath;
+            });
+        }
+
+        void clear() {
+            entries.clear();
+        }
+
+        // call function(file path, template) for all cached templates
+        template <typename Function>
+        void for_each(Function&& function) const {
+            for(const auto& [key, entry] : entries) {
+                function(key.file, entry.tmpl);
+            }
+        }
+
+        size_t size() const {
+            return entries.size();
+        }
+    };
+
+} // namespace Wizard
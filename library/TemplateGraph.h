@@ -0,0 +1,107 @@
+#pragma once
+#include <map>
+#include <set>
+#include <vector>
+#include <filesystem>
+#include "Template.h"
+
+namespace Wizard
+{
+    // References of templates by apply-template statements (template name => names of nested templates)
+    // the template name is the file path (relative to templates directory) without extension
+    class TemplateGraph
+    {
+        using Names = std::set<std::filesystem::path>;
+
+        std::map<std::filesystem::path, Names> edges;
+        std::map<std::filesystem::path, Names> cached_files; // template name => cached files (with extension)
+
+    public:
+        static std::filesystem::path template_name(const std::filesystem::path& path) {
+            auto name = path;
+            name.replace_extension();
+            return name.lexically_normal();
+        }
+
+        // add (or replace) references of template
+        void add(const std::filesystem::path& name, const Template& tmpl) {
+            auto& nested = edges[name];
+            nested.clear();
+            if(tmpl.program) {
+                for(const auto& nested_name : tmpl.program->templates) {
+                    nested.insert(nested_name.lexically_normal());
+                }
+            }
+        }
+
+        // template is cached as file (e.g. .tpl or precompiled .wzc)
+        void add_file(const std::filesystem::path& name, const std::filesystem::path& path) {
+            cached_files[name].insert(path.lexically_normal());
+        }
+
+        void remove(const std::filesystem::path& name) {
+            edges.erase(name);
+            cached_files.erase(name);
+        }
+
+        void clear() {
+            edges.clear();
+            cached_files.clear();
+        }
+
+        bool contains(const std::filesystem::path& name) const {
+            return edges.contains(name);
+        }
+
+        // cached files of template (empty for nested templates which are only in template storage)
+        const Names& files(const std::filesystem::path& name) const {
+            static const Names empty;
+            const auto it = cached_files.find(name);
+            return it != cached_files.end() ? it->second : empty;
+        }
+
+        // nested templates of template
+        const Names& dependencies(const std::filesystem::path& name) const {
+            static const Names empty;
+            const auto it = edges.find(name);
+            return it != edges.end() ? it->second : empty;
+        }
+
+        // nested templates of template used directly or through other nested templates
+        Names nested(const std::filesystem::path& name) const {
+            Names result;
+            std::vector<std::filesystem::path> queue{name};
+            while(!queue.empty()) {
+                const auto current = std::move(queue.back());
+                queue.pop_back();
+                for(const auto& child : dependencies(current)) {
+                    if(child != name && result.insert(child).second) {
+                        queue.push_back(child);
+                    }
+                }
+            }
+            return result;
+        }
+
+        // templates using the template directly or through other templates
+        Names dependents(const std::filesystem::path& name) const {
+            Names result;
+            std::vector<std::filesystem::path> queue{name};
+            while(!queue.empty()) {
+                const auto current = std::move(queue.back());
+                queue.pop_back();
+                for(const auto& [parent, nested] : edges) {
+                    if(nested.contains(current) && parent != name && result.insert(parent).second) {
+                        queue.push_back(parent);
+                    }
+                }
+            }
+            return result;
+        }
+
+        size_t size() const {
+            return edges.size();
+        }
+    };
+
+} // namespace Wizard
@@ -0,0 +1,119 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define WIZARD_TEXT_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace Wizard {
+
+	// Search of template open characters (vectorized on x86, scalar fallback otherwise)
+	namespace text_scan {
+
+		// SIMD search supports up to the number of different characters (more is scalar search)
+		constexpr size_t max_simd_chars = 8;
+
+		inline size_t find_first_of_scalar(std::string_view text, std::string_view chars, size_t start = 0)
+		{
+			for (size_t i = start; i < text.size(); ++i) {
+				if (chars.find(text[i]) != std::string_view::npos) {
+					return i;
+				}
+			}
+			return std::string_view::npos;
+		}
+
+#ifdef WIZARD_TEXT_SCAN_X86
+		// 16 bytes per step
+		inline size_t find_first_of_sse2(std::string_view text, std::string_view chars)
+		{
+			if (chars.size() > max_simd_chars) {
+				return find_first_of_scalar(text, chars);
+			}
+			__m128i needles[max_simd_chars];
+			for (size_t k = 0; k < chars.size(); ++k) {
+				needles[k] = _mm_set1_epi8(chars[k]);
+			}
+			const char* data = text.data();
+			size_t i = 0;
+			for (; i + 16 <= text.size(); i += 16) {
+				const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				__m128i found = _mm_setzero_si128();
+				for (size_t k = 0; k < chars.size(); ++k) {
+					found = _mm_or_si128(found, _mm_cmpeq_epi8(block, needles[k]));
+				}
+				const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(found));
+				if (mask != 0) {
+					return i + std::countr_zero(mask);
+				}
+			}
+			return find_first_of_scalar(text, chars, i);
+		}
+
+#if defined(__GNUC__) || defined(__clang__)
+		// 32 bytes per step (used only if CPU supports AVX2)
+		__attribute__((target("avx2")))
+		inline size_t find_first_of_avx2(std::string_view text, std::string_view chars)
+		{
+			if (chars.size() > max_simd_chars) {
+				return find_first_of_scalar(text, chars);
+			}
+			__m256i needles[max_simd_chars];
+			for (size_t k = 0; k < chars.size(); ++k) {
+				needles[k] = _mm256_set1_epi8(chars[k]);
+			}
+			const char* data = text.data();
+			size_t i = 0;
+			for (; i + 32 <= text.size(); i += 32) {
+				const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				__m256i found = _mm256_setzero_si256();
+				for (size_t k = 0; k < chars.size(); ++k) {
+					found = _mm256_or_si256(found, _mm256_cmpeq_epi8(block, needles[k]));
+				}
+				const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(found));
+				if (mask != 0) {
+					return i + std::countr_zero(mask);
+				}
+			}
+			// tail is shorter than 32 bytes
+			const size_t tail = find_first_of_sse2(text.substr(i), chars);
+			return tail == std::string_view::npos ? tail : i + tail;
+		}
+#endif
+#endif
+
+		using FindFunction = size_t (*)(std::string_view, std::string_view);
+
+		inline size_t find_first_of_default(std::string_view text, std::string_view chars)
+		{
+			return find_first_of_scalar(text, chars);
+		}
+
+		// the best implementation for current CPU
+		inline FindFunction select_find_first_of()
+		{
+#ifdef WIZARD_TEXT_SCAN_X86
+#if defined(__GNUC__) || defined(__clang__)
+			if (__builtin_cpu_supports("avx2")) {
+				return find_first_of_avx2;
+			}
+#endif
+			return find_first_of_sse2;
+#else
+			return find_first_of_default;
+#endif
+		}
+
+		// position of the first character from chars or npos
+		inline size_t find_first_of(std::string_view text, std::string_view chars)
+		{
+			static const FindFunction implementation = select_find_first_of();
+			return implementation(text, chars);
+		}
+
+	} // namespace text_scan
+
+} // namespace Wizard
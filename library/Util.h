@@ -6,7 +6,15 @@
 #include <filesystem>
 #include <iomanip>
 #include <queue>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <boost/json/parse.hpp>
+#include <boost/json/stream_parser.hpp>
+#include <boost/json/monotonic_resource.hpp>
 namespace json = boost::json;
 #include "Exceptions.h"
 
@@ -250,6 +258,100 @@ namespace Wizard {
 		return {std::istreambuf_iterator<char>{ifs}, {}};
 	}
 
+	// read-only file mapped into memory (whole file is read if mapping isn't supported)
+	class MappedFile
+	{
+		const char* data_{nullptr};
+		size_t size_{0};
+		std::string buffer_;
+
+	public:
+		explicit MappedFile(const std::filesystem::path& filepath)
+		{
+#ifdef _WIN32
+			buffer_ = read_file(filepath);
+			data_ = buffer_.data();
+			size_ = buffer_.size();
+#else
+			int fd = ::open(filepath.c_str(), O_RDONLY);
+			if (fd < 0) {
+				throw FileError("Couldn't open file: \"" + filepath.string() + "\"");
+			}
+			struct stat st;
+			if (::fstat(fd, &st) != 0) {
+				::close(fd);
+				throw FileError("Couldn't read file: \"" + filepath.string() + "\"");
+			}
+			size_ = static_cast<size_t>(st.st_size);
+			if (size_ > 0) {
+				void* memory = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (memory == MAP_FAILED) {
+					::close(fd);
+					throw FileError("Couldn't map file: \"" + filepath.string() + "\"");
+				}
+				data_ = static_cast<const char*>(memory);
+				// the file is read once from start to end
+				::madvise(memory, size_, MADV_SEQUENTIAL);
+			}
+			::close(fd);
+#endif
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+#ifndef _WIN32
+			if (data_ && size_ > 0) {
+				::munmap(const_cast<char*>(data_), size_);
+			}
+#endif
+		}
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+		std::string_view view() const { return {data_, size_}; }
+	};
+
+	// an arena for parsed json (all nodes are freed at once with the last value using it)
+	inline json::storage_ptr make_json_arena()
+	{
+		return json::make_shared_resource<json::monotonic_resource>();
+	}
+
+	// parse json file mapped into memory (the file is fed to parser by large blocks)
+	// the result is allocated by storage (e.g. make_json_arena() for large data)
+	inline json::value read_json_file(const std::filesystem::path& filepath, std::error_code& ec,
+									  json::storage_ptr storage = {})
+	{
+		constexpr size_t block_size = 4 * 1024 * 1024;
+		MappedFile file(filepath);
+		json::stream_parser parser;
+		parser.reset(std::move(storage));
+		for(size_t pos = 0; pos < file.size(); pos += block_size) {
+			parser.write(file.data() + pos, std::min(block_size, file.size() - pos), ec);
+			if(ec) {
+				return nullptr;
+			}
+		}
+		parser.finish(ec);
+		if(ec) {
+			return nullptr;
+		}
+		return parser.release();
+	}
+
+	inline json::value read_json_file(const std::filesystem::path& filepath, json::storage_ptr storage = {})
+	{
+		std::error_code ec;
+		auto result = read_json_file(filepath, ec, std::move(storage));
+		if(ec) {
+			throw FileError("Couldn't parse json file: \"" + filepath.string() + "\": " + ec.message());
+		}
+		return result;
+	}
+
 	// find template description file
 	inline std::filesystem::path get_template_description_file(const std::filesystem::path& filetpl,
 											        		   const std::filesystem::path& descjson)
@@ -301,13 +403,11 @@ namespace Wizard {
 			return {};
 		}
 		// read template description
-		std::ifstream infile;
-		infile.open(filepath);
-		if(infile.fail()) {
+		if(!std::filesystem::is_regular_file(filepath)) {
 			return {};
 		}
 		std::error_code ec;
-		auto tpldesc = json::parse(infile, ec);
+		auto tpldesc = read_json_file(filepath, ec, make_json_arena());
 		if(ec) {
 			throw FileError("Couldn't parse template description file: '" + filepath.string() + "'");
 		}
@@ -1,9 +1,13 @@
 
 #include <filesystem>
+#include <memory>
+#include <set>
 #include <boost/program_options.hpp>
 #include <clocale>
 #include "library/Environment.h"
 #include "library/Project.h"
+#include "library/FileWatcher.h"
+#include "library/RenderServer.h"
 #include "helper.h"
 namespace po = boost::program_options;
 
@@ -175,22 +179,39 @@ int create_template_description(Wizard::Environment& env,
 
 // check data by template description
 
-// read and parse json file
-int read_json(const std::filesystem::path& fdata, json::value& data)
+// read and parse json file (only fields of filter), error message is returned
+bool read_json(const std::filesystem::path& fdata, json::value& data,
+			   const Wizard::DataFilter& filter, std::string& error)
 {
-	// read json data
-	std::ifstream jsonfile;
-	jsonfile.open(fdata);
-	if(jsonfile.fail()) {
-		std::cerr << "Couldn't open JSON data file: " << std::quoted(fdata.string()) <<  std::endl;
-		return 1;		
-	}
-	// parse json
+	// read and parse json data (mapped file) into own arena
 	std::error_code ec;
-	data = json::parse(jsonfile, ec);
+	try{
+		auto parsed = filter.read_file(fdata, ec, Wizard::make_json_arena());
+		if(!ec) {
+			// move construction keeps the arena (assignment would copy into storage of data),
+			// the previous data and its arena are freed at once
+			std::destroy_at(&data);
+			std::construct_at(&data, std::move(parsed));
+		}
+	} catch(Wizard::FileError&) {
+		error = "Couldn't open JSON data file: \"" + fdata.string() + "\"";
+		return false;
+	}
 	if(ec) {
-		std::cerr << ec.message() << std::endl;
-		return 1;		
+		error = ec.message();
+		return false;
+	}
+	return true;
+}
+
+// read and parse json file (only fields of filter)
+int read_json(const std::filesystem::path& fdata, json::value& data,
+			  const Wizard::DataFilter& filter = Wizard::DataFilter::all())
+{
+	std::string error;
+	if(!read_json(fdata, data, filter, error)) {
+		std::cerr << error << std::endl;
+		return 1;
 	}
 	return 0;
 }
@@ -199,17 +220,28 @@ int read_json(const std::filesystem::path& fdata, json::value& data)
 int render_template(Wizard::Environment& env,
 				    const std::filesystem::path& ftpl,
 				    const std::filesystem::path& finfo,
-					const std::filesystem::path& fdata)
+					const std::filesystem::path& fdata,
+					bool lazy_data = false)
 {
+	// set templates directory (search nested templates)
+	std::filesystem::path tpldir = ftpl.parent_path();
+	env.set_template_directory(tpldir);
+	// fields used by the template (lazy data loading)
+	auto filter = Wizard::DataFilter::all();
+	if(lazy_data) {
+		try{
+			filter = env.data_filter_file(ftpl.filename(), finfo);
+		} catch(Wizard::BaseError& err) {
+			std::cerr << err.what() <<  std::endl;
+			return 1;		
+		}
+	}
 	// read json data
 	json::value data;
-	if(read_json(fdata, data)) {
+	if(read_json(fdata, data, filter)) {
 		return 1;
 	}
 	try{
-		// set templates directory (search nested templates)
-		std::filesystem::path tpldir = ftpl.parent_path();
-		env.set_template_directory(tpldir);
 		// render template
 		auto result = env.render_file(ftpl.filename(), data, finfo);
 		// output render result if the dry run is set
@@ -227,7 +259,8 @@ int render_template(Wizard::Environment& env,
 int render_project(Wizard::Environment& env,
 				   const std::filesystem::path& fproject,
 				   const std::filesystem::path& finfo,
-				   const std::filesystem::path& fdata)
+				   const std::filesystem::path& fdata,
+				   size_t jobs)
 {
 	// read json data
 	json::value data;
@@ -238,7 +271,7 @@ int render_project(Wizard::Environment& env,
 		Wizard::Project project;
 		project.init(fproject);
 		// render template
-		auto result = project.render(env, data, finfo);
+		auto result = project.render(env, data, finfo, jobs);
 		// output render result if the dry run is set
 		if(env.is_dry_run()) {
 			std::cout << result << std::endl;
@@ -250,6 +283,382 @@ int render_project(Wizard::Environment& env,
 	return 0;
 }
 
+// file name matches pattern with * and ? wildcards
+bool match_wildcard(std::string_view pattern, std::string_view name)
+{
+	if(pattern.empty()) {
+		return name.empty();
+	}
+	if(pattern.front() == '*') {
+		for(size_t i = 0; i <= name.size(); ++i) {
+			if(match_wildcard(pattern.substr(1), name.substr(i))) {
+				return true;
+			}
+		}
+		return false;
+	}
+	if(name.empty() || (pattern.front() != '?' && pattern.front() != name.front())) {
+		return false;
+	}
+	return match_wildcard(pattern.substr(1), name.substr(1));
+}
+
+// data of batch rendering
+struct BatchRecord {
+	std::string name;				// name of output directory
+	std::filesystem::path file;		// data file
+	std::string text;				// or json text (NDJSON record)
+};
+
+// records of batch: directory (*.json files), glob (dir/*.json), list of data files or "-" (NDJSON from stdin)
+bool read_batch(const std::string& batch, std::vector<BatchRecord>& records)
+{
+	auto add_file = [&records](const std::filesystem::path& file) {
+		records.push_back({file.stem().string(), file, {}});
+	};
+	std::filesystem::path path = batch;
+	const auto filename = path.filename().string();
+	std::error_code ec;
+	if(batch == "-") {
+		std::string line;
+		while(std::getline(std::cin, line)) {
+			if(line.find_first_not_of(" \t\r") != std::string::npos) {
+				records.push_back({std::to_string(records.size() + 1), {}, std::move(line)});
+			}
+		}
+	} else if(std::filesystem::is_directory(path, ec) || filename.find_first_of("*?") != std::string::npos) {
+		const bool is_dir = std::filesystem::is_directory(path, ec);
+		auto dir = is_dir ? path : path.parent_path();
+		auto pattern = is_dir ? std::string("*.json") : filename;
+		if(dir.empty()) {
+			dir = ".";
+		}
+		std::vector<std::filesystem::path> files;
+		std::filesystem::directory_iterator it(dir, ec), end;
+		for(; !ec && it != end; it.increment(ec)) {
+			if(it->is_regular_file(ec) && match_wildcard(pattern, it->path().filename().string())) {
+				files.push_back(it->path());
+			}
+		}
+		if(ec) {
+			std::cerr << "Couldn't read batch directory: " << std::quoted(dir.string()) << ": " << ec.message() << std::endl;
+			return false;
+		}
+		std::sort(files.begin(), files.end());
+		std::for_each(files.begin(), files.end(), add_file);
+	} else {
+		std::ifstream list(path);
+		if(list.fail()) {
+			std::cerr << "Couldn't open batch list file: " << std::quoted(batch) << std::endl;
+			return false;
+		}
+		std::string line;
+		while(std::getline(list, line)) {
+			if(!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if(!line.empty()) {
+				add_file(line);
+			}
+		}
+	}
+	// output directories of records must differ (records are rendered concurrently)
+	std::set<std::string> names;
+	for(const auto& record : records) {
+		if(!names.insert(record.name).second) {
+			std::cerr << "Duplicate name of batch record: " << std::quoted(record.name)
+					  << " (data files must have different names)" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// render template for every record of batch (the template is parsed once)
+// output of every record is in own subdirectory of output directory
+int render_batch(Wizard::Environment& env,
+				 const std::filesystem::path& ftpl,
+				 const std::filesystem::path& finfo,
+				 const std::string& batch,
+				 size_t jobs)
+{
+	std::vector<BatchRecord> records;
+	if(!read_batch(batch, records)) {
+		return 1;
+	}
+	try{
+		env.set_template_directory(ftpl.parent_path());
+		const auto& tpl = env.cached_template(ftpl.filename(), finfo);
+		const auto frozen = env.freeze();
+		const auto& config = frozen.get_render_config();
+
+		std::vector<std::string> results(records.size());
+		std::vector<std::string> errors(records.size());
+		Wizard::parallel_for(records.size(), jobs, [&](size_t i) {
+			// a failed record must not stop the others
+			try{
+				const auto& record = records[i];
+				json::value data;
+				if(!record.file.empty() && !read_json(record.file, data, Wizard::DataFilter::all(), errors[i])) {
+					return;
+				}
+				std::error_code ec;
+				if(record.file.empty()) {
+					data = json::parse(record.text, ec);
+				}
+				if(ec) {
+					errors[i] = ec.message();
+					return;
+				}
+				auto record_config = config;
+				if(!config.dry_run) {
+					record_config.output_dir = config.output_dir / record.name;
+				}
+				Wizard::StringSink output(results[i]);
+				frozen.render(output, tpl, data, record_config);
+			} catch(std::exception& err) {
+				results[i].clear();
+				errors[i] = err.what();
+			}
+		});
+
+		int result = 0;
+		for(size_t i = 0; i < records.size(); ++i) {
+			if(!errors[i].empty()) {
+				std::cerr << records[i].name << ": " << errors[i] << std::endl;
+				result = 1;
+			} else if(config.dry_run) {
+				std::cout << results[i];
+			}
+		}
+		return result;
+	} catch(Wizard::BaseError& err) {
+		std::cerr << err.what() <<  std::endl;
+		return 1;
+	}
+}
+
+// render server (parsed templates are kept between requests)
+int serve(const std::filesystem::path& socket)
+{
+#ifndef _WIN32
+	Wizard::Environment env;
+	Wizard::RenderServer server(env);
+	try{
+		std::cerr << "Listening on " << std::quoted(socket.string()) << std::endl;
+		server.run(socket);
+	} catch(Wizard::BaseError& err) {
+		std::cerr << err.what() <<  std::endl;
+		return 1;
+	}
+	return 0;
+#else
+	std::cerr << "Render server isn't supported on this platform" << std::endl;
+	return 1;
+#endif
+}
+
+// is file inside directory
+bool is_inside(const std::filesystem::path& file, const std::filesystem::path& dir)
+{
+	auto relative = file.lexically_relative(dir);
+	return !relative.empty() && *relative.begin() != "..";
+}
+
+// wait for changes of watched files, errors of watcher are reported and watching continues
+bool wait_changes(Wizard::FileWatcher& watcher, Wizard::FileWatcher::Paths& changed)
+{
+	try{
+		changed = watcher.wait();
+	} catch(std::exception& err) {
+		std::cerr << err.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// watch template: render again after changes of template files, description or data
+int watch_template(Wizard::Environment& env,
+				   const std::filesystem::path& ftpl,
+				   const std::filesystem::path& finfo,
+				   const std::filesystem::path& fdata,
+				   bool lazy_data)
+{
+	const auto tpldir = ftpl.parent_path().empty() ? std::filesystem::current_path()
+												   : std::filesystem::absolute(ftpl.parent_path()).lexically_normal();
+	Wizard::FileWatcher watcher;
+	watcher.add_directory(tpldir);
+	watcher.add_file(fdata);
+	if(!finfo.empty()) {
+		watcher.add_file(finfo);
+	}
+	const auto info_path = finfo.empty() ? finfo : std::filesystem::absolute(finfo).lexically_normal();
+	render_template(env, ftpl, finfo, fdata, lazy_data);
+	for(;;) {
+		std::cerr << "Waiting for changes..." << std::endl;
+		Wizard::FileWatcher::Paths changed;
+		if(!wait_changes(watcher, changed)) {
+			continue;
+		}
+		if(watcher.overflowed()) {
+			// changes are lost, all templates are parsed again
+			env.clear_template_cache();
+		} else {
+			for(const auto& path : changed) {
+				if(is_inside(path, tpldir)) {
+					// parsed templates are kept except changed ones and their parents
+					env.invalidate_template(path.lexically_relative(tpldir));
+				} else if(!finfo.empty() && path == info_path) {
+					env.invalidate_template(ftpl.filename());
+				}
+			}
+		}
+		render_template(env, ftpl, finfo, fdata, lazy_data);
+	}
+	return 0;
+}
+
+// watch project: render affected modules again after changes of templates, project or data
+int watch_project(Wizard::Environment& env,
+				  const std::filesystem::path& fproject,
+				  const std::filesystem::path& finfo,
+				  const std::filesystem::path& fdata,
+				  size_t jobs)
+{
+	auto absolute = [](const std::filesystem::path& path) {
+		return std::filesystem::absolute(path).lexically_normal();
+	};
+	const auto cdir = absolute(std::filesystem::current_path());
+	Wizard::Project project;
+	json::value data;
+	// render modules, all if the list is empty
+	auto render = [&](std::vector<Wizard::Module> modules) {
+		try{
+			Wizard::Project affected = project;
+			if(!modules.empty()) {
+				affected.modules = std::move(modules);
+			}
+			auto result = affected.render(env, data, finfo, jobs);
+			if(env.is_dry_run()) {
+				std::cout << result << std::endl;
+			}
+		} catch(Wizard::BaseError& err) {
+			std::cerr << err.what() <<  std::endl;
+		}
+	};
+	auto load = [&]() {
+		try{
+			project = Wizard::Project{};
+			project.init(fproject);
+		} catch(Wizard::BaseError& err) {
+			std::cerr << err.what() <<  std::endl;
+			return false;
+		}
+		return read_json(fdata, data) == 0;
+	};
+	if(!load()) {
+		return 1;
+	}
+
+	Wizard::FileWatcher watcher;
+	watcher.add_file(fproject);
+	watcher.add_file(fdata);
+	if(!finfo.empty()) {
+		watcher.add_file(finfo);
+	}
+	std::set<std::filesystem::path> tpldirs;
+	for(const auto& module : project.modules) {
+		tpldirs.insert(absolute(module.name).parent_path());
+	}
+	for(const auto& dir : tpldirs) {
+		watcher.add_directory(dir);
+	}
+	render({});
+	for(;;) {
+		std::cerr << "Waiting for changes..." << std::endl;
+		Wizard::FileWatcher::Paths changed;
+		if(!wait_changes(watcher, changed)) {
+			continue;
+		}
+		if(watcher.overflowed() || changed.contains(absolute(fproject)) || changed.contains(absolute(fdata)) ||
+		   (!finfo.empty() && changed.contains(absolute(finfo)))) {
+			// everything is rendered again
+			env.clear_template_cache();
+			if(load()) {
+				render({});
+			}
+			continue;
+		}
+		// changed templates and templates using them
+		std::set<std::filesystem::path> names;
+		for(const auto& path : changed) {
+			const auto relative = path.lexically_relative(cdir);
+			const auto name = Wizard::TemplateGraph::template_name(relative);
+			names.insert(name);
+			names.merge(env.get_template_graph().dependents(name));
+			env.invalidate_template(relative);
+		}
+		std::vector<Wizard::Module> modules;
+		for(const auto& module : project.modules) {
+			if(names.contains(Wizard::TemplateGraph::template_name(module.name))) {
+				modules.push_back(module);
+			}
+		}
+		if(!modules.empty()) {
+			render(std::move(modules));
+		}
+	}
+	return 0;
+}
+
+// compile template into binary file
+int compile_template(Wizard::Environment& env,
+				     const std::filesystem::path& ftpl,
+				     const std::filesystem::path& finfo,
+				     std::filesystem::path fout)
+{
+	if(fout.empty()) {
+		fout = ftpl;
+		fout.replace_extension(Wizard::TemplateArchive::extension);
+	}
+	try{
+		// set templates directory (search nested templates)
+		env.set_template_directory(ftpl.parent_path());
+		env.compile_file(ftpl.filename(), fout, finfo);
+		std::cout << "Compiled: " << std::quoted(fout.string()) << std::endl;
+	} catch(Wizard::BaseError& err) {
+		std::cerr << err.what() <<  std::endl;
+		return 1;		
+	}
+	return 0;
+}
+
+// compile project templates (each one near its template)
+int compile_project(Wizard::Environment& env,
+				    const std::filesystem::path& fproject,
+				    const std::filesystem::path& finfo)
+{
+	try{
+		Wizard::Project project;
+		project.init(fproject);
+		for(const auto& module : project.modules) {
+			std::filesystem::path ftpl = module.name;
+			if(Wizard::TemplateArchive::is_archive(ftpl)) {
+				continue; // already compiled
+			}
+			auto ifile = !finfo.empty() ? finfo : (!module.info.empty() ? module.info : project.info);
+			std::filesystem::path fout = ftpl;
+			fout.replace_extension(Wizard::TemplateArchive::extension);
+			env.compile_file(ftpl, fout, ifile);
+			std::cout << "Compiled: " << std::quoted(fout.string()) << std::endl;
+		}
+	} catch(Wizard::BaseError& err) {
+		std::cerr << err.what() <<  std::endl;
+		return 1;		
+	}
+	return 0;
+}
+
 int main(int argc, const char* argv[])
 {
 	std::setlocale(LC_ALL, "");
@@ -265,12 +674,21 @@ int main(int argc, const char* argv[])
 		("create-info,c", po::value<std::string>()->implicit_value(""), "create/update template description (into json file)")
 		("output,o", po::value<std::string>(), "output directory")
 		("project,p", po::value<std::string>(), "input project file")
+		("compile", po::value<std::string>()->implicit_value(""), "compile template (or project templates) into binary file (.wzc)")
+		("jobs,j", po::value<size_t>()->default_value(1), "number of threads rendering project modules or batch records (0 - all cores)")
+		("watch,w", "render again after changes of templates, project or data file")
+		("lazy-data", "parse only data fields used by the template (the other values are skipped)")
+		("serve", po::value<std::string>(), "render server: json requests (one per line) on the Unix domain socket")
+		("batch,b", po::value<std::string>(), "render template for many data: directory, glob (dir/*.json), list of data files or - (NDJSON from stdin)")
 		;
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
 	po::notify(vm);
 
+	if(vm.count("serve")) {
+		return serve(vm["serve"].as<std::string>());
+	}
 	if (vm.count("help") || (!vm.count("template") && !vm.count("project"))) {
 		std::cerr << desc << std::endl;
 		return 1;
@@ -280,7 +698,7 @@ int main(int argc, const char* argv[])
 	if(vm.count("template")) {
 		std::filesystem::path filetpl = vm["template"].as<std::string>();
 		// show template info
-		if(vm.count("info") && !vm.count("data")) {
+		if(vm.count("info") && !vm.count("data") && !vm.count("compile")) {
 			std::filesystem::path infodat = vm["info"].as<std::string>();
 			try{
 				template_description(env, filetpl, infodat);
@@ -302,6 +720,36 @@ int main(int argc, const char* argv[])
 			return 0;
 		}
 	}
+	// compile templates
+	if(vm.count("compile")) {
+		std::filesystem::path infodat;
+		if (vm.count("info")) {
+			infodat = vm["info"].as<std::string>();
+		}
+		if(vm.count("template")) {
+			std::filesystem::path filetpl = vm["template"].as<std::string>();
+			return compile_template(env, filetpl, infodat, vm["compile"].as<std::string>());
+		}
+		std::filesystem::path project = vm["project"].as<std::string>();
+		return compile_project(env, project, infodat);
+	}
+	// many data files (output of every one in own subdirectory)
+	if(vm.count("batch")) {
+		if(!vm.count("template")) {
+			std::cerr << "Please specify template file (-t,--template)" << std::endl;
+			return 1;
+		}
+		std::filesystem::path infodat;
+		if (vm.count("info")) {
+			infodat = vm["info"].as<std::string>();
+		}
+		if(vm.count("output")) {
+			env.set_output_dir(vm["output"].as<std::string>());
+		} else {
+			env.set_dry_run(true); // test rendering
+		}
+		return render_batch(env, vm["template"].as<std::string>(), infodat, vm["batch"].as<std::string>(), vm["jobs"].as<size_t>());
+	}
 	// json data file
 	if(!vm.count("data")) {
 		std::cerr << "Please specify JSON data file (-d,--data)" << std::endl;
@@ -323,11 +771,17 @@ int main(int argc, const char* argv[])
 	if(vm.count("template")) {
 		// render template
 		std::filesystem::path filetpl = vm["template"].as<std::string>();
-		return render_template(env, filetpl, infodat, filedata);
+		if(vm.count("watch")) {
+			return watch_template(env, filetpl, infodat, filedata, vm.count("lazy-data") != 0);
+		}
+		return render_template(env, filetpl, infodat, filedata, vm.count("lazy-data") != 0);
 	} else if(vm.count("project")) {
 		// render project
 		std::filesystem::path project = vm["project"].as<std::string>();
-		return render_project(env, project, infodat, filedata);
+		if(vm.count("watch")) {
+			return watch_project(env, project, infodat, filedata, vm["jobs"].as<size_t>());
+		}
+		return render_project(env, project, infodat, filedata, vm["jobs"].as<size_t>());
 	}
 	return 0;
 }
@@ -0,0 +1,69 @@
+#include <sstream>
+#include <string>
+#include <fstream>
+#include <doctest/doctest.h>
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+#include "helper.h"
+#include "../library/Environment.h"
+#include "../library/TemplateArchive.h"
+
+using namespace Wizard;
+
+extern GlobalFixture fixture;
+
+TEST_CASE("Precompiled template") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_template_archive";
+    std::filesystem::create_directories(dir);
+    auto write_file = [&dir](const std::string& name, const std::string& text) {
+        std::ofstream file(dir / name, std::ios::trunc);
+        file << text;
+    };
+    write_file("main.tpl", "{# main #}{% set title = upper(name) %}{{ title }}:\n"
+                           "{% for key, value in options %}{{ key }}={{ value }}{% if not loop.is_last %}, {% endif %}{% endfor %}\n"
+                           "{% apply-template item items %}"
+                           "{{ length([1, 2.5, \"x\", {\"a\": null}]) }} {{ default(missing, 1 + 2 * 3) }} {{ twice(2) }}");
+    write_file("item.tpl", "- {{ name }}{% if loop.is_last %}.{% else %};{% endif %}\n");
+
+    json::value data = {
+        {"name", "archive"},
+        {"options", {{"a", 1}, {"b", true}}},
+        {"items", json::array{json::object{{"name", "first"}}, json::object{{"name", "second"}}}}
+    };
+    auto twice = [](Arguments& args) { return args[0]->as_int64() * 2; };
+
+    Environment env;
+    env.set_template_directory(dir);
+    env.add_callback("twice", 1, twice);
+    const auto expected = env.render_file("main.tpl", data);
+    CHECK(expected == "ARCHIVE:\na=1, b=1\n- first;\n- second.\n4 7 4");
+
+    env.compile_file("main.tpl", dir / "main.wzc");
+
+    SUBCASE("load in new environment") {
+        Environment compiled_env;
+        compiled_env.set_template_directory(dir);
+        compiled_env.add_callback("twice", 1, twice);
+        // source templates aren't needed
+        std::filesystem::remove(dir / "main.tpl");
+        std::filesystem::remove(dir / "item.tpl");
+        CHECK(compiled_env.render_file("main.wzc", data) == expected);
+        CHECK(compiled_env.get_templates().size() == 1);
+    }
+
+    SUBCASE("unknown callback") {
+        Environment compiled_env;
+        compiled_env.set_template_directory(dir);
+        CHECK_THROWS_AS(compiled_env.render_file("main.wzc", data), FileError);
+    }
+
+    SUBCASE("not precompiled file") {
+        Environment compiled_env;
+        compiled_env.set_template_directory(dir);
+        write_file("broken.wzc", "{{ name }}");
+        CHECK_THROWS_AS(compiled_env.render_file("broken.wzc", data), FileError);
+    }
+
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,418 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <doctest/doctest.h>
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+#include "helper.h"
+#include "../library/Parser.h"
+#include "../library/Renderer.h"
+#include "../library/Compiler.h"
+
+using namespace Wizard;
+
+extern GlobalFixture fixture;
+
+static std::vector<OpCode> opcodes(const Program& program) {
+    std::vector<OpCode> result;
+    for(const auto& ins : program.code) {
+        result.push_back(ins.code);
+    }
+    return result;
+}
+
+// heap allocations of this test binary (counted by replaced global operator new)
+static std::atomic<size_t> allocation_count{0};
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(std::size_t size) {
+    if(void* p = operator new(size, std::nothrow)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+TEST_CASE("Compile template") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+
+    Parser parser(pconfig, lconfig, templates, functions);
+
+    SUBCASE("text and expression") {
+        Template tpl = parser.parse("Hello {{ name }}!");
+        REQUIRE(tpl.program);
+        CHECK(opcodes(*tpl.program) == std::vector<OpCode>{OpCode::Text, OpCode::Data, OpCode::Print, OpCode::Text});
+        CHECK(tpl.program->names == std::vector<std::string>{"name"});
+    }
+
+    SUBCASE("constants and function") {
+        Template tpl = parser.parse("{{ 1 + 2 }}");
+        REQUIRE(tpl.program);
+        CHECK(opcodes(*tpl.program) == std::vector<OpCode>{OpCode::Constant, OpCode::Constant, OpCode::Call, OpCode::Print});
+        CHECK(tpl.program->constants.size() == 2);
+        CHECK(tpl.program->code[2].operation == FunctionStorage::Operation::Add);
+        CHECK(tpl.program->code[2].arg == 2);
+    }
+
+    SUBCASE("short-circuit") {
+        Template tpl = parser.parse("{{ a and b }}");
+        REQUIRE(tpl.program);
+        const auto& code = tpl.program->code;
+        CHECK(opcodes(*tpl.program) == std::vector<OpCode>{OpCode::Data, OpCode::And, OpCode::Data, OpCode::Bool, OpCode::Print});
+        CHECK(code[1].target == 4);
+    }
+
+    SUBCASE("if else") {
+        Template tpl = parser.parse("{% if a %}yes{% else %}no{% endif %}");
+        REQUIRE(tpl.program);
+        const auto& code = tpl.program->code;
+        CHECK(opcodes(*tpl.program) == std::vector<OpCode>{OpCode::Data, OpCode::JumpIfFalse, OpCode::Text, OpCode::Jump, OpCode::Text});
+        CHECK(code[1].target == 4);
+        CHECK(code[3].target == 5);
+    }
+
+    SUBCASE("loop") {
+        Template tpl = parser.parse("{% for item in items %}{{ item }}{% endfor %}");
+        REQUIRE(tpl.program);
+        const auto& code = tpl.program->code;
+        CHECK(opcodes(*tpl.program) == std::vector<OpCode>{OpCode::Data, OpCode::ForArray, OpCode::Local, OpCode::Print, OpCode::Next});
+        CHECK(code[1].target == 5);
+        CHECK(code[4].target == 2);
+        // variable names are shared
+        CHECK(tpl.program->names == std::vector<std::string>{"items", "item"});
+        // loop variable is resolved to the slot of loop
+        REQUIRE(tpl.program->slots.size() == 3);
+        CHECK(tpl.program->slots[0].kind == Slot::Kind::Value);
+        CHECK(tpl.program->locals[code[2].extra].slot == code[1].arg);
+    }
+
+    SUBCASE("set variables") {
+        Template tpl = parser.parse("{{ x }}{% set x = 1 %}{% for i in items %}{% set x = i %}{% set i = 0 %}{{ loop.index }}{% endfor %}{{ x }}");
+        REQUIRE(tpl.program);
+        const auto& program = *tpl.program;
+        CHECK(opcodes(program) == std::vector<OpCode>{OpCode::Local, OpCode::Print, OpCode::Constant, OpCode::Set,
+                                                      OpCode::Data, OpCode::ForArray, OpCode::Local, OpCode::Set,
+                                                      OpCode::Constant, OpCode::Set, OpCode::Local, OpCode::Print,
+                                                      OpCode::Next, OpCode::Local, OpCode::Print});
+        // template variable (used before set too), loop variable, loop metadata
+        const auto x = program.code[3].arg;
+        CHECK(program.slots[x].kind == Slot::Kind::Set);
+        CHECK(program.locals[program.code[0].extra].slot == x);
+        CHECK(program.code[7].arg == x);
+        CHECK(program.code[9].arg == program.code[5].arg);
+        CHECK(program.locals[program.code[10].extra].slot == program.code[5].arg + 2);
+    }
+
+    SUBCASE("data paths") {
+        Template tpl = parser.parse("{{ person.name }}{{ person.age }}{{ person.name }}");
+        REQUIRE(tpl.program);
+        const auto& program = *tpl.program;
+        // paths are split at compile time, segments are shared
+        REQUIRE(program.paths.size() == 2);
+        CHECK(program.code[0].extra == program.code[4].extra);
+        const auto& name_path = program.paths[program.code[0].extra];
+        const auto& age_path = program.paths[program.code[2].extra];
+        REQUIRE(name_path.size() == 2);
+        REQUIRE(age_path.size() == 2);
+        CHECK(name_path[0] == age_path[0]);
+        CHECK(program.names[name_path[0]] == "person");
+        CHECK(program.names[name_path[1]] == "name");
+        CHECK(program.names[age_path[1]] == "age");
+    }
+}
+
+TEST_CASE("Render compiled template") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+
+    Parser parser(pconfig, lconfig, templates, functions);
+    RenderConfig rconfig;
+    rconfig.dry_run = true;
+    json::value data = {
+        {"items", {1, 2, 3}},
+        {"person", {{"name", "Peter"}}},
+        {"flag", false}
+    };
+
+    SUBCASE("nested loops and conditions") {
+        Template tpl = parser.parse("{% for i in items %}{% if loop.is_first %}[{% else %},{% endif %}"
+                                    "{% for j in items %}{% if j == i %}{{ loop.parent.index1 }}{% endif %}{% endfor %}"
+                                    "{% if loop.is_last %}]{% endif %}{% endfor %}");
+        Renderer renderer(rconfig, templates, functions);
+        std::stringstream ss;
+        renderer.render(ss, tpl, data);
+        CHECK(ss.str() == "[1,2,3]");
+    }
+
+    SUBCASE("empty loop") {
+        Template tpl = parser.parse("a{% for i in range(0) %}{{ i }}{% endfor %}b{{ existsIn(person, \"i\") }}");
+        Renderer renderer(rconfig, templates, functions);
+        std::stringstream ss;
+        renderer.render(ss, tpl, data);
+        CHECK(ss.str() == "ab0");
+    }
+
+    SUBCASE("short-circuit does not evaluate second argument") {
+        rconfig.strict = true;
+        Template tpl = parser.parse("{{ flag and missing }}{{ not flag or missing }}{{ default(person.name, missing) }}");
+        Renderer renderer(rconfig, templates, functions);
+        std::stringstream ss;
+        renderer.render(ss, tpl, data);
+        CHECK(ss.str() == "01Peter");
+    }
+
+    SUBCASE("loop variables") {
+        // inner loop shadows outer variable, set statement inside loop
+        Template tpl = parser.parse("{% for i in items %}{% for i in range(1) %}{{ i }}{% endfor %}{{ i }}"
+                                    "{% set last = i %}{% if loop.is_last %}.{{ loop.index1 }}{% endif %}{% endfor %}"
+                                    "{% for key, value in person %}{{ key }}={{ value }}{% endfor %} {{ last }}");
+        Renderer renderer(rconfig, templates, functions);
+        std::stringstream ss;
+        renderer.render(ss, tpl, data);
+        CHECK(ss.str() == "010203.3name=Peter 3");
+    }
+
+    SUBCASE("data path through array") {
+        json::value people = {
+            {"people", json::array{ {{"name", "Ann"}}, {{"age", 5}}, {{"name", "Bob"}} }},
+            {"single", json::array{ {{"name", "Eve"}} }}
+        };
+        Template tpl = parser.parse("{{ people.name }} {{ single.name }} {{ people.age }}");
+        Renderer renderer(rconfig, templates, functions);
+        std::stringstream ss;
+        renderer.render(ss, tpl, people);
+        CHECK(ss.str() == "[\"Ann\",\"Bob\"] Eve 5");
+    }
+
+    SUBCASE("set variables and nested template") {
+        templates.emplace("Sub", parser.parse("{{ loop.index }}:{{ name }}:{{ x }}:{{ i }}:{{ loop.parent.index }};"));
+        json::value people = {
+            {"people", json::array{ {{"name", "Ann"}}, {{"name", "Bob"}} }}
+        };
+        Template tpl = parser.parse("{{ x }}{% set x = 7 %}{% for i in range(2) %}{% set i = i + 1 %}\n"
+                                    "## apply-template Sub people\n"
+                                    "{% endfor %}{{ x }}");
+        Renderer renderer(rconfig, templates, functions);
+        std::stringstream ss;
+        renderer.render(ss, tpl, people);
+        CHECK(ss.str() == "\n0:Ann:7:1:0;1:Bob:7:1:0;\n0:Ann:7:2:1;1:Bob:7:2:1;7");
+    }
+
+    SUBCASE("template without program") {
+        Template tpl = parser.parse("{{ person.name }}");
+        tpl.program.reset();
+        Renderer renderer(rconfig, templates, functions);
+        std::stringstream ss;
+        renderer.render(ss, tpl, data);
+        CHECK(ss.str() == "Peter");
+    }
+}
+
+TEST_CASE("Render temporary values") {
+    TemporaryValues temporaries;
+    std::vector<const json::value*> values;
+    for(int i = 0; i < 40; ++i) {
+        values.push_back(temporaries.make(json::value(i)));
+    }
+    CHECK(values[39]->as_int64() == 39);
+    CHECK(temporaries.owns(values[0]));
+    CHECK(temporaries.owns(values[39]));
+    json::value other(1);
+    CHECK(!temporaries.owns(&other));
+    auto taken = temporaries.take(values[5]);
+    CHECK(taken.as_int64() == 5);
+    // memory is reused after reset
+    temporaries.reset();
+    CHECK(temporaries.make(json::value("text")) == values[0]);
+
+    // temporaries of each expression are released
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+    Parser parser(pconfig, lconfig, templates, functions);
+    RenderConfig rconfig;
+    Template tpl = parser.parse("{% for i in range(1000) %}{% if i % 500 == 0 %}{{ i * 2 + 1 }},{% endif %}{% endfor %}");
+    Renderer renderer(rconfig, templates, functions);
+    std::stringstream ss;
+    renderer.render(ss, tpl, json::value(json::object_kind));
+    CHECK(ss.str() == "1,1001,");
+}
+
+TEST_CASE("Render expression results") {
+    json::value data = json::parse(R"({"items": [1, 2, 3]})");
+    EvalResult borrowed(&data);
+    CHECK(!borrowed.is_owned());
+    CHECK(borrowed.get() == &data);
+    EvalResult owned(json::value("text"));
+    CHECK(owned.is_owned());
+    CHECK(owned->as_string() == "text");
+    // borrowed value is copied on release, data is not touched
+    auto copy = std::move(borrowed).release();
+    CHECK(copy == data);
+    CHECK(data.as_object().size() == 1);
+    // own() detaches result from data
+    EvalResult detached(&data.as_object()["items"]);
+    detached.own();
+    CHECK(detached.is_owned());
+    data.as_object()["items"] = 0;
+    CHECK(detached->as_array().size() == 3);
+
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+    Parser parser(pconfig, lconfig, templates, functions);
+    RenderConfig rconfig;
+    Template tpl = parser.parse("{% set x = items %}{% for i in range(2) %}{{ i }}{% endfor %}{% for v in x %}{{ v }}{% endfor %}{{ missing }}");
+    Renderer renderer(rconfig, templates, functions);
+    std::stringstream ss;
+    renderer.render(ss, tpl, json::parse(R"({"items": [4, 5]})"));
+    CHECK(ss.str() == "0145");
+
+    // loop over large input array borrows it (set statement in the body doesn't copy it)
+    functions.add_callback("address", 1, [](Arguments& args) {
+        return json::value(reinterpret_cast<std::uintptr_t>(args[0]));
+    });
+    json::value large(json::object_kind);
+    auto& items = large.as_object()["items"].emplace_array();
+    for(int i = 0; i < 10000; ++i) {
+        items.emplace_back(i);
+    }
+    Template loop = parser.parse("{% for v in items %}{% set x = v %}{% if loop.is_last %}{{ address(v) }}{% endif %}{% endfor %}");
+    std::stringstream ls;
+    renderer.render(ls, loop, large);
+    CHECK(ls.str() == std::to_string(reinterpret_cast<std::uintptr_t>(&items.back())));
+}
+
+TEST_CASE("Render loops without copies") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+    // address of argument (loop variable refers to input data or to a copy)
+    functions.add_callback("address", 1, [](Arguments& args) {
+        return json::value(reinterpret_cast<std::uintptr_t>(args[0]));
+    });
+    Parser parser(pconfig, lconfig, templates, functions);
+    RenderConfig rconfig;
+    json::value data = json::parse(R"({"tables": [{"name": "a", "columns": [1, 2]}, {"name": "b", "columns": [3]}]})");
+    const auto& tables = data.at("tables").as_array();
+    auto address = [](const json::value& value) {
+        return std::to_string(reinterpret_cast<std::uintptr_t>(&value));
+    };
+
+    // set statement inside loops doesn't copy input data
+    Template tpl = parser.parse("{% for t in tables %}{% set n = t.name %}{{ address(t) }},"
+                                "{% for c in t.columns %}{% set m = c %}{{ address(c) }},{% endfor %}{% endfor %}");
+    Renderer renderer(rconfig, templates, functions);
+    std::stringstream ss;
+    renderer.render(ss, tpl, data);
+    const auto& columns_a = tables[0].at("columns").as_array();
+    const auto& columns_b = tables[1].at("columns").as_array();
+    CHECK(ss.str() == address(tables[0]) + "," + address(columns_a[0]) + "," + address(columns_a[1]) + "," +
+                      address(tables[1]) + "," + address(columns_b[0]) + ",");
+
+    // loop over variable which is replaced by set statement iterates its copy
+    Template replaced = parser.parse("{% set x = tables %}{% for t in x %}{% set x = 0 %}{{ t.name }}"
+                                     "{% for c in t.columns %}{{ c }}{% endfor %}{% endfor %}{{ x }}");
+    std::stringstream rs;
+    renderer.render(rs, replaced, data);
+    CHECK(rs.str() == "a12b30");
+}
+
+TEST_CASE("Render after failed render") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+    Parser parser(pconfig, lconfig, templates, functions);
+    RenderConfig rconfig;
+    templates.emplace("Row", parser.parse("{{ name }};{% if exists(\"i\") %}i{% endif %}"));
+    // upper of number throws inside loop
+    Template failing = parser.parse("{% for i in items %}{{ upper(i) }}{% endfor %}");
+    Template applying = parser.parse("## apply-template Row rows\n");
+    json::value data = {{"items", {1, 2}}, {"rows", {{{"name", "a"}}}}};
+
+    // running loop of failed render isn't passed to the next render
+    Renderer renderer(rconfig, templates, functions);
+    std::stringstream failed;
+    CHECK_THROWS(renderer.render(failed, failing, data));
+    std::stringstream ss;
+    renderer.render(ss, applying, data);
+    CHECK(ss.str() == "a;");
+
+    // operands of failed expression aren't left on the evaluation stack
+    CHECK_THROWS(renderer.render(failed, parser.parse("{{ length(rows) + upper(1) }}"), data));
+    CHECK(renderer.evaluate_expression(parser.parse("{{ length(rows) }}"), data) == 1);
+    std::stringstream again;
+    renderer.render(again, applying, data);
+    CHECK(again.str() == "a;");
+}
+
+TEST_CASE("Render data lookups without allocations") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+    Parser parser(pconfig, lconfig, templates, functions);
+    RenderConfig rconfig;
+    Template tpl = parser.parse("{% for x in items %}{% if x.a.b %}{% endif %}{% if x %}{% endif %}{% if name %}{% endif %}{% endfor %}");
+    auto described = tpl;
+    described.desc.variables["name"] = Variable{"name"};
+
+    // allocations of render don't depend on number of lookups
+    auto allocations = [&](const Template& tmpl, size_t size) {
+        json::value data = {{"name", "n"}};
+        auto& items = data.as_object()["items"].emplace_array();
+        for(size_t i = 0; i < size; ++i) {
+            items.push_back(json::value{{"a", {{"b", i}}}});
+        }
+        Renderer renderer(rconfig, templates, functions);
+        std::string result;
+        StringSink output(result);
+        renderer.render(output, tmpl, data);
+        const size_t before = allocation_count.load();
+        renderer.render(output, tmpl, data);
+        return allocation_count.load() - before;
+    };
+    CHECK(allocations(tpl, 1000) == allocations(tpl, 10));
+    CHECK(allocations(described, 1000) == allocations(described, 10));
+}
@@ -1,10 +1,14 @@
 #include <doctest/doctest.h>
 #include <boost/json/value.hpp>
 #include <algorithm>
+#include <thread>
+#include <csignal>
 namespace json = boost::json;
 
 #include "helper.h"
 #include "../library/Environment.h"
+#include "../library/FileWatcher.h"
+#include "../library/RenderServer.h"
 
 using namespace Wizard;
 
@@ -94,3 +98,427 @@ TEST_CASE("Ealuate expression") {
     }
 
 }
+
+
+TEST_CASE("Environment template cache") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_template_cache";
+    std::filesystem::create_directories(dir);
+    auto write_template = [&dir](const std::string& text) {
+        std::ofstream file(dir / "greeting.tpl", std::ios::trunc);
+        file << text;
+    };
+    write_template("Hello {{ name }}");
+
+    Environment env;
+    env.set_template_directory(dir);
+    json::value data = { {"name", "Peter"} };
+
+    CHECK(env.render_file("greeting.tpl", data) == "Hello Peter");
+    CHECK(env.get_template_cache().size() == 1);
+    // second render uses parsed template
+    CHECK(env.render_file("greeting.tpl", data) == "Hello Peter");
+    CHECK(env.get_template_cache().size() == 1);
+
+    // changed file is parsed again
+    write_template("Goodbye {{ name }}");
+    CHECK(env.render_file("greeting.tpl", data) == "Goodbye Peter");
+    CHECK(env.get_template_cache().size() == 1);
+
+    env.invalidate_template("greeting.tpl");
+    CHECK(env.get_template_cache().size() == 0);
+    CHECK(env.render_file("greeting.tpl", data) == "Goodbye Peter");
+
+    // changed nested template and description file are loaded again
+    std::ofstream(dir / "table.tpl") << "table:\n## apply-template row rows\n";
+    std::ofstream(dir / "row.tpl") << "row {{ name }}";
+    json::value rows = {{"rows", {{{"name", "a"}}}}};
+    CHECK(env.render_file("table.tpl", rows) == "table:\nrow a");
+    std::ofstream(dir / "row.tpl", std::ios::trunc) << "line {{ name }}!";
+    CHECK(env.render_file("table.tpl", rows) == "table:\nline a!");
+
+    auto info = dir / "greeting.json";
+    std::ofstream(info) << R"({"template": "greeting", "description": "first"})";
+    CHECK(env.cached_template("greeting.tpl", info).desc.description == "first");
+    std::ofstream(info, std::ios::trunc) << R"({"template": "greeting", "description": "second"})";
+    std::filesystem::last_write_time(info, std::filesystem::last_write_time(info) + std::chrono::seconds(1));
+    CHECK(env.cached_template("greeting.tpl", info).desc.description == "second");
+
+    env.clear_template_cache();
+    CHECK(env.get_template_cache().size() == 0);
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Environment output sinks") {
+    Environment env;
+    auto tpl = env.parse("{% for i in items %}{{ i }},{% endfor %}");
+    json::value data = {{"items", {1, 2, 3}}};
+
+    SUBCASE("string sink appends to string") {
+        std::string result = "header:";
+        {
+            StringSink output(result);
+            env.render(output, tpl, data);
+            // large text is larger than the initial capacity
+            output.write(std::string(10000, 'x'));
+        }
+        CHECK(result.size() == 7 + 6 + 10000);
+        CHECK(result.starts_with("header:1,2,3,x"));
+    }
+    SUBCASE("counting sink") {
+        CountingSink output;
+        for(int i = 0; i < 1000; ++i) {
+            env.render(output, tpl, data);
+        }
+        CHECK(output.count() == 6000);
+    }
+    SUBCASE("file sink") {
+        auto path = std::filesystem::temp_directory_path() / "wizard_output_sink.txt";
+        {
+            FileSink output(path, 4);
+            CHECK(!output.fail());
+            env.render(output, tpl, data);
+            output.put('!');
+        }
+        std::ifstream file(path);
+        std::string result;
+        std::getline(file, result);
+        CHECK(result == "1,2,3,!");
+        file.close();
+        std::filesystem::remove(path);
+        // error of the last write is reported by close
+        if(std::filesystem::exists("/dev/full")) {
+            FileSink full("/dev/full");
+            CHECK(!full.fail());
+            env.render(full, tpl, data);
+            CHECK_THROWS_AS(full.close(), FileError);
+        }
+    }
+    SUBCASE("stream sink") {
+        std::stringstream ss;
+        {
+            StreamSink output(ss, 4);
+            env.render(output, tpl, data);
+        }
+        CHECK(ss.str() == "1,2,3,");
+    }
+}
+
+TEST_CASE("Environment freeze") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_frozen_environment";
+    std::filesystem::create_directories(dir);
+    {
+        std::ofstream file(dir / "list.tpl", std::ios::trunc);
+        file << "{% for item in items %}{{ twice(item) }},{% endfor %}";
+    }
+    Environment env;
+    env.set_template_directory(dir);
+    env.add_callback("twice", 1, [](Arguments& args) {
+        return json::value(args[0]->as_int64() * 2);
+    });
+    const auto frozen = env.freeze({"list.tpl"});
+    // callbacks are bound by parser
+    const auto expression = env.parse_expression("twice(21)");
+
+    // later changes of environment aren't visible (new callback, changed template file)
+    env.add_callback("thrice", 1, [](Arguments& args) {
+        return json::value(args[0]->as_int64() * 3);
+    });
+    {
+        std::ofstream file(dir / "list.tpl", std::ios::trunc);
+        file << "{% for item in items %}{{ thrice(item) }};{% endfor %}";
+    }
+    env.clear_template_cache();
+    const json::value items = {{"items", {1, 2}}};
+    CHECK(env.render_file("list.tpl", items) == "3;6;");
+    CHECK(frozen.render_file("list.tpl", items) == "2,4,");
+    CHECK(frozen.contains_file("list.tpl"));
+    CHECK(!frozen.contains_file("other.tpl"));
+    CHECK_THROWS_AS(frozen.get_file("other.tpl"), FileError);
+
+    std::vector<std::string> results(8);
+    {
+        std::vector<std::jthread> threads;
+        for(size_t t = 0; t < results.size(); ++t) {
+            threads.emplace_back([&frozen, &results, t] {
+                json::value data = {{"items", {1, 2, static_cast<int64_t>(t)}}};
+                for(int i = 0; i < 100; ++i) {
+                    results[t] = frozen.render_file("list.tpl", data);
+                }
+            });
+        }
+    }
+    for(size_t t = 0; t < results.size(); ++t) {
+        CHECK(results[t] == "2,4," + std::to_string(t * 2) + ",");
+    }
+    CHECK(frozen.evaluate_expression(expression, json::value{}).as_int64() == 42);
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Environment template dependencies") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_template_graph";
+    std::filesystem::create_directories(dir / "sub");
+    auto write_template = [&dir](const std::string& name, const std::string& text) {
+        std::ofstream file(dir / name, std::ios::trunc);
+        file << text;
+    };
+    write_template("Root.tpl", "root:\n## apply-template sub/Table tables\n");
+    write_template("sub/Table.tpl", "table {{ name }}\n## apply-template Field fields\n");
+    write_template("sub/Field.tpl", "field {{ name }}\n");
+    write_template("Other.tpl", "other {{ name }}");
+    write_template("Main.txt", "main:\n## apply-template sub/Table tables\n");
+
+    Environment env;
+    env.set_template_directory(dir);
+    json::value data = {{"name", "x"}, {"tables", {{{"name", "t"}, {"fields", {{{"name", "f"}}}}}}}};
+    CHECK(env.render_file("Root.tpl", data) == "root:\ntable t\nfield f\n");
+    CHECK(env.render_file("Other.tpl", data) == "other x");
+    CHECK(env.render_file("Main.txt", data) == "main:\ntable t\nfield f\n");
+
+    const auto& graph = env.get_template_graph();
+    CHECK(graph.dependencies("Root") == std::set<std::filesystem::path>{"sub/Table"});
+    CHECK(graph.dependencies("sub/Table") == std::set<std::filesystem::path>{"sub/Field"});
+    CHECK(graph.dependents("sub/Field") == std::set<std::filesystem::path>{"Main", "Root", "sub/Table"});
+    CHECK(graph.files("Main") == std::set<std::filesystem::path>{"Main.txt"});
+    CHECK(graph.dependents("Other").empty());
+
+    // only changed template and templates using it are parsed again
+    write_template("sub/Field.tpl", "column {{ name }}\n");
+    env.invalidate_template("sub/Field.tpl");
+    CHECK(env.get_template_cache().size() == 1);
+    CHECK(!env.get_templates().contains("sub/Field"));
+    CHECK(graph.contains("Other"));
+    CHECK(env.render_file("Root.tpl", data) == "root:\ntable t\ncolumn f\n");
+    CHECK(env.get_template_cache().size() == 2);
+    // root with other extension is parsed again too
+    CHECK(env.render_file("Main.txt", data) == "main:\ntable t\ncolumn f\n");
+    CHECK(env.get_template_cache().size() == 3);
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Environment file watcher") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_file_watcher";
+    std::filesystem::create_directories(dir / "sub");
+    auto data = std::filesystem::temp_directory_path() / "wizard_file_watcher.json";
+    std::ofstream(data) << "{}";
+
+    FileWatcher watcher;
+    watcher.add_directory(dir);
+    watcher.add_file(data);
+    CHECK(watcher.wait(std::chrono::milliseconds(0)).empty());
+
+    std::ofstream(dir / "sub" / "Table.tpl") << "table";
+    auto changed = watcher.wait(std::chrono::milliseconds(5000));
+    CHECK(changed.contains(std::filesystem::absolute(dir / "sub" / "Table.tpl").lexically_normal()));
+
+    std::ofstream(data) << "[]";
+    changed = watcher.wait(std::chrono::milliseconds(5000));
+    CHECK(changed == FileWatcher::Paths{std::filesystem::absolute(data).lexically_normal()});
+    CHECK(!watcher.overflowed());
+
+#ifdef __linux__
+    // wait interrupted by signal continues
+    struct sigaction action{}, previous{};
+    action.sa_handler = [](int) {};
+    sigaction(SIGUSR1, &action, &previous);
+    const auto waiting = pthread_self();
+    std::thread writer([&dir, waiting]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        pthread_kill(waiting, SIGUSR1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::ofstream(dir / "Signal.tpl") << "signal";
+    });
+    changed = watcher.wait();
+    writer.join();
+    sigaction(SIGUSR1, &previous, nullptr);
+    CHECK(changed.contains(std::filesystem::absolute(dir / "Signal.tpl").lexically_normal()));
+
+    // subdirectory removed before it is watched is skipped
+    std::filesystem::create_directories(dir / "temp" / "nested");
+    std::filesystem::remove_all(dir / "temp");
+    std::ofstream(dir / "After.tpl") << "after";
+    CHECK_NOTHROW(changed = watcher.wait(std::chrono::milliseconds(5000)));
+    CHECK(changed.contains(std::filesystem::absolute(dir / "After.tpl").lexically_normal()));
+
+    // lost events are reported as changes of everything
+    size_t max_events = 16384;
+    std::ifstream("/proc/sys/fs/inotify/max_queued_events") >> max_events;
+    for(size_t i = 0; i < max_events / 2 + 100; ++i) {
+        std::ofstream(dir / "sub" / ("File" + std::to_string(i) + ".tpl"));
+    }
+    changed = watcher.wait(std::chrono::milliseconds(5000));
+    CHECK(watcher.overflowed());
+    CHECK(changed.contains(std::filesystem::absolute(dir).lexically_normal()));
+    CHECK(changed.contains(std::filesystem::absolute(data).lexically_normal()));
+#endif
+
+    std::filesystem::remove_all(dir);
+    std::filesystem::remove(data);
+}
+
+TEST_CASE("Environment render server") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_render_server";
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir / "Hello.tpl") << "Hello {{ name }}!";
+    const auto file = (dir / "Hello.tpl").string();
+
+    Environment env;
+    env.set_template_directory(dir);
+    RenderServer server(env);
+    auto response = json::parse(server.handle(R"({"template": ")" + file + R"(", "data": {"name": "world"}})"));
+    CHECK(response.at("ok") == true);
+    CHECK(response.at("output") == "Hello world!");
+    CHECK(server.directory_environment(dir).get_template_cache().size() == 1);
+    // parsed template is reused
+    response = json::parse(server.handle(R"({"template": ")" + file + R"(", "data": {"name": "again"}})"));
+    CHECK(response.at("output") == "Hello again!");
+    CHECK(server.directory_environment(dir).get_template_cache().size() == 1);
+    CHECK(env.get_template_cache().size() == 0);
+
+    // nested templates with the same name in other directories
+    for(const auto name : {"a", "b"}) {
+        std::filesystem::create_directories(dir / name);
+        std::ofstream(dir / name / "Main.tpl") << "## apply-template Table table\n";
+        std::ofstream(dir / name / "Table.tpl") << name << ":{{ name }}";
+    }
+    for(const auto name : {"a", "b", "a"}) {
+        response = json::parse(server.handle(R"({"template": ")" + (dir / name / "Main.tpl").string() +
+                                             R"(", "data": {"table": {"name": "t"}}})"));
+        CHECK(response.at("output") == std::string(name) + ":t");
+    }
+
+    response = json::parse(server.handle(R"({"data": {}})"));
+    CHECK(response.at("ok") == false);
+    response = json::parse(server.handle("not json"));
+    CHECK(response.at("ok") == false);
+    response = json::parse(server.handle(R"({"template": ")" + (dir / "Missing.tpl").string() + R"("})"));
+    CHECK(response.at("ok") == false);
+    CHECK(!response.at("error").as_string().empty());
+
+    // project uses templates of the server directory and doesn't change configs of environment
+    std::ofstream(dir / "project.json") << R"({"name": "p", "description": "", "modules": [)"
+                                           R"({"template": "Hello.tpl", "rules": []}, {"template": "Hello.tpl", "rules": []}]})";
+    const auto project = (dir / "project.json").string();
+    response = json::parse(server.handle(R"({"project": ")" + project + R"(", "data": {"name": "p"}, "jobs": 2})"));
+    CHECK(response.at("output") == "Hello p!Hello p!");
+    response = json::parse(server.handle(R"({"project": ")" + project + R"(", "output": ")" + (dir / "out").string() +
+                                         R"(", "data": {"name": "o"}})"));
+    CHECK(response.at("ok") == true);
+    CHECK(server.directory_environment(dir).get_template_cache().size() == 1);
+    CHECK(server.directory_environment(dir).get_render_config().output_dir.empty());
+    CHECK(env.get_render_config().output_dir.empty());
+    CHECK(env.get_template_cache().size() == 0);
+
+#ifndef _WIN32
+    const auto socket_path = dir / "server.sock";
+    server.set_max_request_size(1024);
+    std::thread thread([&] { server.run(socket_path); });
+    auto connect_client = [&] {
+        int fd = -1;
+        for(int attempt = 0; attempt < 500 && fd < 0; ++attempt) {
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            socket_path.string().copy(address.sun_path, sizeof(address.sun_path) - 1);
+            if(::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+                ::close(fd);
+                fd = -1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        return fd;
+    };
+    const std::string request = R"({"template": ")" + file + R"(", "data": {"name": "socket"}})" "\n";
+    // clients closed before reading of response don't stop the server (SIGPIPE)
+    for(int i = 0; i < 20; ++i) {
+        const int early = connect_client();
+        REQUIRE(early >= 0);
+        CHECK(::write(early, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+        ::close(early);
+    }
+    const int fd = connect_client();
+    REQUIRE(fd >= 0);
+    CHECK(::write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()));
+    std::string line;
+    char c;
+    while(::read(fd, &c, 1) == 1 && c != '\n') {
+        line += c;
+    }
+    ::close(fd);
+    response = json::parse(line);
+    CHECK(response.at("output") == "Hello socket!");
+
+    // line without end longer than limit is rejected
+    const int flood = connect_client();
+    REQUIRE(flood >= 0);
+    const std::string garbage(2000, 'x');
+    CHECK(::write(flood, garbage.data(), garbage.size()) == static_cast<ssize_t>(garbage.size()));
+    line.clear();
+    while(::read(flood, &c, 1) == 1 && c != '\n') {
+        line += c;
+    }
+    CHECK(json::parse(line).at("ok") == false);
+    CHECK(::read(flood, &c, 1) == 0);
+    ::close(flood);
+
+    // idle clients are disconnected by stop
+    const int idle = connect_client();
+    REQUIRE(idle >= 0);
+    server.stop();
+    thread.join();
+    CHECK(::read(idle, &c, 1) <= 0);
+    ::close(idle);
+    CHECK(!std::filesystem::exists(socket_path));
+#endif
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Environment data filter") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_data_filter";
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir / "Main.tpl") << "{{ title }}{% if exists(\"extra.flag\") %}!{% endif %}\n"
+                                       "## for p in products\n"
+                                       "{{ p.name }};\n"
+                                       "## endfor\n"
+                                       "## apply-template Item catalog.items\n";
+    std::ofstream(dir / "Item.tpl") << "{{ name }}:{{ details.size }}\n";
+    const std::string text = R"({"title": "T", "unused": {"text": "}]\"{[", "list": [1, {"a": [true, null]}]},
+        "products": [{"name": "p1", "price": 1}], "extra": {"flag": false, "other": 2},
+        "catalog": {"name": "c", "items": [{"name": "i1", "details": {"size": 1, "color": "red"}, "price": 2},
+                                            {"name": "i2", "details": {"size": 2}}]}})";
+    const auto data = json::parse(text);
+    const json::value expected = {{"title", "T"}, {"products", {{{"name", "p1"}, {"price", 1}}}},
+                                  {"extra", {{"flag", false}}},
+                                  {"catalog", {{"items", {{{"name", "i1"}, {"details", {{"size", 1}}}},
+                                                          {{"name", "i2"}, {"details", {{"size", 2}}}}}}}}};
+
+    Environment env;
+    env.set_template_directory(dir);
+    const auto filter = env.data_filter_file("Main.tpl");
+    CHECK(!filter.is_all());
+    CHECK(filter.apply(data) == expected);
+    std::error_code ec;
+    CHECK(filter.parse(text, ec) == expected);
+    CHECK(!ec);
+    CHECK(env.render_file("Main.tpl", filter.apply(data)) == env.render_file("Main.tpl", data));
+
+    auto file = dir / "data.json";
+    std::ofstream(file) << text;
+    CHECK(filter.read_file(file, ec, make_json_arena()) == expected);
+    CHECK(!ec);
+    filter.parse(R"({"title": "T", "unused": {"a": [1, 2}})", ec);
+    CHECK(ec);
+    filter.parse(R"({"title": "T",)", ec);
+    CHECK(ec);
+    CHECK(DataFilter::all().parse(text, ec) == data);
+
+    // path of exists is unknown before render
+    CHECK(env.data_filter(env.parse("{% if exists(name) %}{% endif %}")).is_all());
+    CHECK(env.data_filter(env.parse("{{ a.b }} {{ a }}")).apply(json::value{{"a", {{"b", 1}, {"c", 2}}}, {"d", 3}}) ==
+          json::value{{"a", {{"b", 1}, {"c", 2}}}});
+
+    std::filesystem::remove_all(dir);
+}
@@ -28,6 +28,58 @@ TEST_CASE("Lexer empty") {
 }
 
 
+TEST_CASE("Lexer text scan") {
+    // all implementations agree with scalar search at every alignment and tail length
+    std::string text(200, 'a');
+    const std::string_view chars = "{#";
+    CHECK(text_scan::find_first_of(text, chars) == std::string_view::npos);
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        text[pos] = (pos % 2) ? '{' : '#';
+        for (size_t start = 0; start <= pos; start += 7) {
+            std::string_view view(text.data() + start, text.size() - start);
+            const size_t expected = text_scan::find_first_of_scalar(view, chars);
+            CHECK(expected == pos - start);
+            CHECK(text_scan::find_first_of(view, chars) == expected);
+#ifdef WIZARD_TEXT_SCAN_X86
+            CHECK(text_scan::find_first_of_sse2(view, chars) == expected);
+#endif
+        }
+        text[pos] = 'a';
+    }
+    // more characters than SIMD search supports
+    CHECK(text_scan::find_first_of("abcdefghijk", "kjihgfedcx") == 2);
+}
+
+
+TEST_CASE("Lexer default delimiters") {
+    LexerConfig config;
+    CHECK(is_default_delimiters(config));
+    config.templates_dir = "templates";
+    CHECK(is_default_delimiters(config));
+
+    // lexer with compile-time delimiters gives the same tokens
+    auto filepath = fixture.templatesDir;
+    filepath /= "sql/DatabaseSchema.tpl";
+    std::string str = read_file(filepath) + "{{- name -}} {%- if a -%}{% endif %} {#- comment -#}";
+    Lexer lexer(config);
+    DefaultLexer default_lexer(config);
+    auto state = lexer.start(str);
+    auto default_state = default_lexer.start(str);
+    size_t count = 0;
+    do {
+        state = lexer.scan(state);
+        default_state = default_lexer.scan(default_state);
+        CHECK(state.token == default_state.token);
+        CHECK(state.token.offset == default_state.token.offset);
+        count += 1;
+    } while (state.token.kind != Token::Kind::Eof && count < 100000);
+    CHECK(default_state.token.kind == Token::Kind::Eof);
+
+    config.expression_open = "<<";
+    CHECK(!is_default_delimiters(config));
+}
+
+
 TEST_CASE("Lexer DatabaseSchema.tpl") {
     
     auto filepath = fixture.templatesDir;
@@ -651,6 +703,41 @@ TEST_CASE("Parser expresssion") {
     CHECK(test_nodes == tvisitor.nodes);
 }
 
+TEST_CASE("Parser node arena") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+
+    Parser parser(pconfig, lconfig, templates, functions);
+    Template root = parser.parse("{% for item in items %}{{ item.name + \"!\" }}{% endfor %}");
+    // for, data (items), expression wrapper, function, data (item.name), literal
+    CHECK(root.arena->size() == 6);
+
+    // copies share nodes
+    Template copy = root;
+    CHECK(copy.arena == root.arena);
+    CHECK(copy.root.nodes.front() == root.root.nodes.front());
+}
+
+TEST_CASE("Parser function node footprint") {
+    // operator metadata lives in a static table, a node keeps only its own fields
+    // (before it was a std::map member: 17 heap allocated entries per node)
+    constexpr size_t fields_size = sizeof(ExpressionNode) + sizeof(std::string) + sizeof(std::vector<ExpressionNode*>) +
+                                   sizeof(CallbackFunction) + 4 * sizeof(int);
+    CHECK(sizeof(FunctionNode) <= fields_size);
+
+    FunctionNode power(FunctionStorage::Operation::Power, 0);
+    CHECK(power.number_args == 2);
+    CHECK(power.precedence == 5);
+    CHECK(power.associativity == FunctionStorage::Associativity::Right);
+
+    FunctionNode length(FunctionStorage::Operation::Length, 0);
+    CHECK(length.number_args == 1);
+    CHECK(length.precedence == 1);
+    CHECK(length.associativity == FunctionStorage::Associativity::Left);
+}
+
 /*
 TEST_CASE("Parser empty") {
     LexerConfig lconfig;
@@ -882,4 +969,47 @@ TEST_CASE("Parser FieldSchema.tpl") {
     // }
 
 }
-*/
\ No newline at end of file
+*/
+TEST_CASE("Parser nested templates in parallel") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_nested_templates";
+    std::filesystem::create_directories(dir);
+    const std::vector<std::pair<std::string, std::string>> files{
+        {"Root", "## apply-template A a\n## apply-template B b\n"},
+        {"A", "A\n## apply-template C c\n"},
+        {"B", "B\n## apply-template C c\n## apply-template D d\n"},
+        {"C", "C {{ name }}\n"},
+        {"D", "D\n## apply-template A a\n"}
+    };
+    for(const auto& [name, text] : files) {
+        std::ofstream file(dir / (name + ".tpl"), std::ios::trunc);
+        file << text;
+    }
+
+    LexerConfig lconfig;
+    lconfig.templates_dir = dir;
+    FunctionStorage functions;
+    auto parse = [&](size_t jobs) {
+        ParserConfig pconfig;
+        pconfig.nested_template_jobs = jobs;
+        TemplateStorage templates;
+        Parser parser(pconfig, lconfig, templates, functions);
+        auto root = parser.parse_file("Root.tpl");
+        CHECK(!root.empty());
+        std::vector<std::string> result;
+        for(const auto& [name, tmpl] : templates) {
+            CHECK(tmpl.program);
+            result.push_back(name.string() + ":" + tmpl.content);
+        }
+        return result;
+    };
+    const auto recursive = parse(1);
+    CHECK(recursive.size() == 4);
+    CHECK(parse(4) == recursive);
+    CHECK(parse(0) == recursive);
+
+    // missing template
+    std::filesystem::remove(dir / "D.tpl");
+    CHECK_THROWS_AS(parse(4), FileError);
+
+    std::filesystem::remove_all(dir);
+}
@@ -43,3 +43,25 @@ TEST_CASE("Project transform test") {
      CHECK(newdata_obj.if_contains("tables"));
      CHECK(newdata_obj.at("tables").is_array());
 }
+
+TEST_CASE("Project parallel render") {
+    auto dir = std::filesystem::temp_directory_path() / "wizard_project_jobs";
+    std::filesystem::create_directories(dir);
+    Project project;
+    for(int i = 0; i < 8; ++i) {
+        auto name = "module" + std::to_string(i) + ".tpl";
+        std::ofstream file(dir / name, std::ios::trunc);
+        file << i << ":{% for item in items %}{{ item }}{% endfor %};";
+        project.modules.emplace_back().name = name;
+    }
+
+    Environment env;
+    env.set_template_directory(dir);
+    json::value data = {{"items", {1, 2, 3}}};
+    auto serial = project.render(env, data);
+    CHECK(serial == "0:123;1:123;2:123;3:123;4:123;5:123;6:123;7:123;");
+    CHECK(project.render(env, data, "", 4) == serial);
+    CHECK(project.render(env, data, "", 0) == serial);
+
+    std::filesystem::remove_all(dir);
+}
@@ -93,6 +93,38 @@ TEST_CASE("Render data") {
 }
 
 
+TEST_CASE("Render numbers and strings") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+
+    Parser parser(pconfig, lconfig, templates, functions);
+    Template tpl = parser.parse("{{ i }}|{{ n }}|{{ u }}|{{ d }}|{{ pi }}|{{ big }}|{{ small }}|{{ b }}|{{ s }}|{{ a }}|{{ o }}|{{ none }}");
+
+    RenderConfig rconfig;
+    Renderer render(rconfig, templates, functions);
+
+    std::stringstream ss;
+    json::value data = {
+        {"i", 42},
+        {"n", -9223372036854775807ll - 1},
+        {"u", 18446744073709551615ull},
+        {"d", 0.1},
+        {"pi", 3.14159265358979},
+        {"big", 1e20},
+        {"small", 0.00001},
+        {"b", true},
+        {"s", std::string("a\0b", 3)},
+        {"a", {1, "x"}},
+        {"o", {{"k", 2}}},
+        {"none", nullptr}
+    };
+    render.render(ss, tpl, data);
+    CHECK(ss.str() == std::string("42|-9223372036854775808|18446744073709551615|0.1|3.14159|1e+20|1e-05|1|a\0b|[1,\"x\"]|{\"k\":2}|", 91));
+}
+
+
 TEST_CASE("Render set statement") {
     LexerConfig lconfig;
     ParserConfig pconfig;
@@ -725,6 +757,27 @@ TEST_CASE("Render file structure (real)") {
 
 }
 
+TEST_CASE("Render file write error") {
+	// every write to /dev/full fails (full disk)
+	if(!std::filesystem::exists("/dev/full")) {
+		return;
+	}
+	LexerConfig lconfig;
+	ParserConfig pconfig;
+	TemplateStorage templates;
+	FunctionStorage functions;
+
+	Parser parser(pconfig, lconfig, templates, functions);
+	// the text fits into the buffer, it is written at the end of file statement
+	Template tpl = parser.parse("{% file \"full\" %}{{ name }}{% endfile %}");
+
+	RenderConfig rconfig;
+	rconfig.output_dir = "/dev";
+	Renderer renderer(rconfig, templates, functions);
+	std::stringstream ss;
+	CHECK_THROWS_AS(renderer.render(ss, tpl, json::value{{"name", "text"}}), RenderError);
+}
+
 TEST_CASE("Render variable test") {
     LexerConfig lconfig;
     ParserConfig pconfig;
@@ -890,3 +943,128 @@ CREATE TABLE IF NOT EXISTS `book` (
 
 }
 
+
+
+TEST_CASE("Render apply template in parallel") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+
+    Parser parser(pconfig, lconfig, templates, functions);
+    templates.emplace("Row", parser.parse("{{ loop.index1 }}:{{ name }}{% if loop.is_first %}<{% endif %}{% if loop.is_last %}>{% endif %};"));
+    Template tpl = parser.parse("## for group in groups\n## apply-template Row items\n## endfor\n");
+
+    json::array items;
+    std::string expected;
+    for(int i = 0; i < 200; ++i) {
+        items.emplace_back(json::object{{"name", "n" + std::to_string(i)}});
+        expected += std::to_string(i + 1) + ":n" + std::to_string(i) + (i == 0 ? "<" : "") + (i == 199 ? ">" : "") + ";";
+    }
+    json::value data = {{"groups", {1, 2}}, {"items", items}};
+
+    RenderConfig rconfig;
+    Renderer sequential(rconfig, templates, functions);
+    std::stringstream ss;
+    sequential.render(ss, tpl, data);
+    CHECK(ss.str() == expected + expected);
+
+    rconfig.apply_template_jobs = 4;
+    Renderer parallel(rconfig, templates, functions);
+    std::stringstream ps;
+    parallel.render(ps, tpl, data);
+    CHECK(ps.str() == ss.str());
+
+    // the first error is reported
+    templates["Row"] = parser.parse("{{ name.first }}");
+    rconfig.strict = true;
+    Renderer failed(rconfig, templates, functions);
+    CHECK_THROWS_AS(failed.render(ps, tpl, data), RenderError);
+}
+
+// memory resource counting allocated bytes
+class CountingResource : public json::memory_resource
+{
+public:
+    size_t allocated{0};
+
+private:
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        allocated += size;
+        return ::operator new(size, std::align_val_t(alignment));
+    }
+
+    void do_deallocate(void* p, std::size_t size, std::size_t alignment) override {
+        ::operator delete(p, size, std::align_val_t(alignment));
+    }
+
+    bool do_is_equal(const json::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST_CASE("Render memory resource") {
+    LexerConfig lconfig;
+    ParserConfig pconfig;
+    TemplateStorage templates;
+    FunctionStorage functions;
+
+    Parser parser(pconfig, lconfig, templates, functions);
+    Template tpl = parser.parse("## set greeting = \"Hello \" + upper(name)\n"
+                                "## for item in sort(items)\n"
+                                "{{ greeting }} {{ lower(item) }}{% if not loop.is_last %},{% endif %}\n"
+                                "## endfor\n"
+                                "{{ join(range(3), \"-\") }} {{ length(split(\"a,b,c\", \",\")) }}");
+    json::value data = {{"name", "world"}, {"items", {"B", "A"}}};
+    const std::string expected = "Hello WORLD a,\nHello WORLD b\n0-1-2 3";
+
+    RenderConfig rconfig;
+    // own arena of every render
+    Renderer renderer(rconfig, templates, functions);
+    for(int i = 0; i < 3; ++i) {
+        std::stringstream ss;
+        renderer.render(ss, tpl, data);
+        CHECK(ss.str() == expected);
+    }
+    // the result of expression doesn't refer to the arena
+    json::value result = renderer.evaluate_expression(parser.parse("{{ upper(name) + \"!\" }}"), data);
+    CHECK(result == "WORLD!");
+
+    // memory resource of caller
+    for(auto storage : {make_json_arena(), json::storage_ptr()}) {
+        Renderer custom(rconfig, templates, functions);
+        custom.set_storage(storage);
+        std::stringstream ss;
+        custom.render(ss, tpl, data);
+        CHECK(ss.str() == expected);
+    }
+
+    // values created by statements are released after each statement, the storage of render holds only variables
+    Template loop = parser.parse("{% for item in items %}{{ upper(item) }}{{ join(range(3), \"-\") }}{{ loop.index }}"
+                                 "{% for i in range(2) %}{{ i }}{% endfor %}{% endfor %}");
+    auto allocated = [&](size_t size) {
+        json::value items(json::array_kind);
+        for(size_t i = 0; i < size; ++i) {
+            items.as_array().emplace_back("item " + std::to_string(i));
+        }
+        CountingResource counting;
+        Renderer custom(rconfig, templates, functions);
+        custom.set_storage(json::storage_ptr(&counting));
+        std::stringstream ss;
+        custom.render(ss, loop, json::value{{"items", std::move(items)}});
+        CHECK(ss.str().starts_with("ITEM 00-1-2001"));
+        return counting.allocated;
+    };
+    CHECK(allocated(1000) == allocated(10));
+
+    // converted and joined values are created by the storage of statement
+    Template typed = parser.parse("{{ count }};{{ join(mixed, \",\") }};{{ title }}");
+    typed.desc.variables["count"] = Variable{"count", "", Variable::Type::String};
+    typed.desc.variables["title"] = Variable{"title", "", Variable::Type::String, false, "none"};
+    json::value mixed = {{"count", 5}, {"mixed", json::array{1, "a", true, json::array{2}}}};
+    for(int i = 0; i < 2; ++i) {
+        std::stringstream ss;
+        renderer.render(ss, typed, mixed);
+        CHECK(ss.str() == "5;1,a,true,[2];none");
+    }
+}
@@ -1,6 +1,7 @@
 #include <array>
 #include <ranges>
 #include <iostream>
+#include <fstream>
 #include <doctest/doctest.h>
 
 #include "helper.h"
@@ -66,4 +67,27 @@ TEST_CASE("Find json values") {
         CHECK(value->is_string());
         CHECK(value->as_string() == name);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Read json file") {
+    auto path = std::filesystem::temp_directory_path() / "wizard_read_json.json";
+    std::string text = "{\"items\": [";
+    for(int i = 0; i < 200000; ++i) {
+        text += (i ? ",{\"id\":" : "{\"id\":") + std::to_string(i) + ",\"name\":\"item " + std::to_string(i) + "\"}";
+    }
+    text += "]}";
+    std::ofstream(path) << text;
+
+    // larger than one block of parser
+    auto data = read_json_file(path, make_json_arena());
+    CHECK(data == json::parse(text));
+    CHECK(data.at("items").as_array().size() == 200000);
+    CHECK(data.at("items").as_array().back().at("name") == "item 199999");
+
+    std::ofstream(path) << "{\"items\": [1, 2";
+    std::error_code ec;
+    CHECK(read_json_file(path, ec).is_null());
+    CHECK(ec);
+    CHECK_THROWS_AS(read_json_file(path), FileError);
+    std::filesystem::remove(path);
+    CHECK_THROWS_AS(read_json_file(path), FileError);
+}